@@ -1,4 +1,10 @@
 #include "NeuCor.h"
+#include "NeuCor_Perf.h"
+#include "NeuCor_FlightRecorder.h"
+#include "NeuCor_Stimulus.h"
+#include "NeuCor_Generations.h"
+#include "NeuCor_Models.h"
+#include "NeuCor_Plasticity.h"
 
 #include <cassert>
 #include <algorithm>
@@ -7,16 +13,35 @@
 #include <queue>
 #include <stdlib.h>
 #include <iostream>
+#include <chrono>
+#include <thread>
 
-namespace {
-inline float randomUnit() {
-    return static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+NeuCor::NeuCor(int n_neurons) {
+    generate(n_neurons);
+}
+
+NeuCor::NeuCor(int n_neurons, std::uint64_t seed) {
+    deterministic = true;
+    rngState = seed;
+    generate(n_neurons);
 }
+
+NeuCor::NeuCor(int n_neurons, std::uint64_t seed, unsigned threads) {
+    deterministic = true;
+    rngState = seed;
+    generate(0);
+    generateBulk(n_neurons, threads);
 }
 
-NeuCor::NeuCor(int n_neurons) {
+void NeuCor::generate(int n_neurons) {
     runSpeed = 1.0;
     runAll = false;
+    hybrid = false;
+    clockDrivenRate = 1000.0;
+    clockDrivenPeriod = 1.0;
+    migrationInterval = 100.0;
+    lastMigration = 0;
+    nextClockTick = 0;
     totalGenNeurons = 0;
     inputArray = nullptr;
     inputArraySize = 0;
@@ -28,6 +53,16 @@ NeuCor::NeuCor(int n_neurons) {
     presynapticFactor = 0.13;
     postsynapticFactor = 0.30;
 
+    neuronTypes.assign(1, NeuronType());
+    neuronTypes[0].traceDecayRate = postsynapticTraceDecay;
+    fixedPoint = false;
+    typeTables.resize(1);
+    updateTypeTables(0, StandardModel::defaultWaveform);
+    neuronModel = NEURON_MODEL_STANDARD;
+    setNeuronKernels<StandardModel>();
+    neuronInitializer = &StandardModel::initialize;
+    setPlasticityRule(PLASTICITY_TRACE);
+
     totalGenNeurons = n_neurons;
     for (int n = 0; n<n_neurons; n++){
         coord3 d;
@@ -35,10 +70,20 @@ NeuCor::NeuCor(int n_neurons) {
         createNeuron(d);
     }
     totalGenNeurons = 0;
+    renumberNeurons(); // Spatial neighbours get nearby IDs, so connections are made in memory order
 
     for (int n = 0; n<n_neurons; n++){
         neurons.at(n).makeConnections();
     }
+
+    reserveSimulationQueue();
+    publishCounters();
+}
+
+void NeuCor::reserveSimulationQueue(){
+    std::vector<simulation> queueStorage; // Room for a few queued events per neuron, so the queue doesn't reallocate while warming up
+    queueStorage.reserve(4*neurons.size() + inputHandler.size());
+    simulationQueue = decltype(simulationQueue)(std::greater<simulation>(), std::move(queueStorage));
 }
 
 NeuCor::~NeuCor(){}
@@ -64,7 +109,100 @@ void NeuCor::setInputRateArray(float inputs[], unsigned inputCount, coord3 input
 }
 
 void NeuCor::addInputOffset(unsigned inputID, float t){
-    inputHandler.at(inputID).lastFire += t;
+    inputHandler.at(inputID).lastFire += toTicks(t);
+}
+
+namespace {
+void addInputSegment(InputFirer& input, InputSegment segment){
+    // Segments which have been followed by another one before the current time can't take effect again
+    const tick_t now = input.parentNet->getTicks();
+    std::size_t ended = 0;
+    while (ended+1 < input.segments.size() && input.segments[ended+1].start <= now) ended++;
+    input.segments.erase(input.segments.begin(), input.segments.begin() + ended);
+
+    auto position = std::upper_bound(input.segments.begin(), input.segments.end(), segment.start,
+        [](tick_t start, const InputSegment& other){return start < other.start;});
+    input.segments.insert(position, std::move(segment));
+}
+}
+
+void NeuCor::scheduleInputRate(unsigned inputID, float time, float rate){
+    InputSegment segment = {};
+    segment.mode = InputSegment::SEGMENT_CONSTANT;
+    segment.start = toTicks(time);
+    segment.rate = rate;
+    addInputSegment(inputHandler.at(inputID), std::move(segment));
+}
+
+void NeuCor::scheduleInputRandomWalk(unsigned inputID, float time, float startRate, float step, float interval, float minRate, float maxRate){
+    assert(minRate <= maxRate);
+    InputSegment segment = {};
+    segment.mode = InputSegment::SEGMENT_RANDOM_WALK;
+    segment.start = toTicks(time);
+    segment.rate = startRate;
+    segment.step = step, segment.minRate = minRate, segment.maxRate = maxRate;
+    segment.interval = std::max<tick_t>(1, toTicks(interval));
+    addInputSegment(inputHandler.at(inputID), std::move(segment));
+}
+
+void NeuCor::scheduleInputLink(unsigned inputID, float time, unsigned sourceID){
+    assert(inputID != sourceID);
+    InputSegment segment = {};
+    segment.mode = InputSegment::SEGMENT_LINKED;
+    segment.start = toTicks(time);
+    segment.source = sourceID;
+    addInputSegment(inputHandler.at(inputID), std::move(segment));
+}
+
+void NeuCor::clearInputSchedule(unsigned inputID){
+    inputHandler.at(inputID).segments.clear();
+}
+
+float NeuCor::getInputRate(unsigned inputID) const {
+    return inputHandler.at(inputID).rate;
+}
+
+void NeuCor::enableStimuli(std::size_t capacity){
+    if (stimulusQueue) return;
+    stimulusQueue.reset(new StimulusQueue(capacity));
+    stimulusInjector.reset(new StimulusInjector(this));
+}
+
+bool NeuCor::injectSpike(std::size_t neuronID, float time){
+    if (!stimulusQueue) return false;
+    return stimulusQueue->push({toTicks(time), 0.0f, static_cast<std::uint32_t>(neuronID), Stimulus::STIMULUS_SPIKE});
+}
+
+bool NeuCor::injectCurrent(std::size_t neuronID, float time, float potential){
+    if (!stimulusQueue) return false;
+    return stimulusQueue->push({toTicks(time), potential, static_cast<std::uint32_t>(neuronID), Stimulus::STIMULUS_CURRENT});
+}
+
+bool NeuCor::injectInputRate(unsigned inputID, float time, float rate){
+    if (!stimulusQueue) return false;
+    return stimulusQueue->push({toTicks(time), rate, inputID, Stimulus::STIMULUS_INPUT_RATE});
+}
+
+void NeuCor::drainStimuli(){
+    // At most one queue's worth per step, so that producers can't keep the step from starting
+    Stimulus stimulus;
+    for (std::size_t drained = 0; drained < stimulusQueue->capacity() && stimulusQueue->pop(stimulus); drained++){
+        if (stimulus.time < currentTick) stimulus.time = currentTick;
+        if (stimulus.type != Stimulus::STIMULUS_INPUT_RATE){
+            stimulusInjector->add(stimulus);
+        }
+        else if (stimulus.target < inputHandler.size()){ // Inputs are scheduled after this, so the change applies within the current step
+            InputSegment segment = {};
+            segment.mode = InputSegment::SEGMENT_CONSTANT;
+            segment.start = stimulus.time;
+            segment.rate = stimulus.value;
+            addInputSegment(inputHandler[stimulus.target], std::move(segment));
+        }
+    }
+}
+
+float NeuCor::inputArrayRate(unsigned inputID) const {
+    return inputArray != nullptr && inputID < inputArraySize ? inputArray[inputID] : 0.0f;
 }
 
 void NeuCor::setDetectors(unsigned detectorNumber, coord3 detectorPositions[], float detectorRadius[]){
@@ -98,39 +236,148 @@ std::size_t NeuCor::getNeuronCount() const {
 
 std::vector<NeuCor::NeuronSnapshot> NeuCor::getNeuronSnapshots() const {
     std::vector<NeuronSnapshot> snapshots;
-    snapshots.reserve(neurons.size());
+    getNeuronSnapshots(snapshots);
+    return snapshots;
+}
 
-    for (const auto& neuron: neurons) {
+std::vector<NeuCor::SynapseSnapshot> NeuCor::getSynapseSnapshots() const {
+    std::vector<SynapseSnapshot> snapshots;
+    getSynapseSnapshots(snapshots);
+    return snapshots;
+}
+
+std::uint64_t NeuCor::getEpoch() const {
+    return epoch;
+}
+
+std::uint64_t NeuCor::getNeuronSnapshots(std::vector<NeuronSnapshot>& snapshots, std::uint64_t since) const {
+    snapshots.clear();
+    auto snapshot = [&](const Neuron& neuron){
+        snapshots.push_back({neuron.getID(), positions[neuron.pos], potAct[neuron.PA], potAct[neuron.PA+1]});
+    };
+
+    if (since <= rebuiltEpoch){
+        snapshots.reserve(neurons.size());
+        for (const auto& neuron: neurons) snapshot(neuron);
+        return epoch;
+    }
+
+    auto change = std::lower_bound(changedNeurons.begin(), changedNeurons.end(), since,
+        [](const std::pair<std::uint64_t, std::size_t>& entry, std::uint64_t e){return entry.first < e;});
+    for (; change != changedNeurons.end(); change++){
+        const Neuron& neuron = neurons[change->second];
+        if (neuron.changedEpoch == change->first) snapshot(neuron); // Otherwise a later entry reports it
+    }
+    return epoch;
+}
+
+std::uint64_t NeuCor::getSynapseSnapshots(std::vector<SynapseSnapshot>& snapshots, std::uint64_t since) const {
+    snapshots.clear();
+    auto snapshot = [&](const Synapse& synapse, coord3 from){
         snapshots.push_back({
-            neuron.getID(),
-            neuron.position(),
-            neuron.potential(),
-            neuron.activity(),
+            synapse.pN,
+            synapse.tN,
+            from,
+            positions[neurons[synapse.tN].pos],
+            synapse.getWeight(),
+            synapse.getPrePot(),
+            synapse.getPostPot(),
+            synapse.getWeight() < 0.0f,
         });
+    };
+
+    if (since <= rebuiltEpoch){
+        snapshots.reserve(synapseCount);
+        for (const auto& neuron: neurons) {
+            const coord3 from = positions[neuron.pos];
+            for (const auto& synapse: neuron.outSynapses)
+                if (!synapse.deleted) snapshot(synapse, from);
+        }
+        return epoch;
     }
 
-    return snapshots;
+    auto change = std::lower_bound(changedSynapses.begin(), changedSynapses.end(), since,
+        [](const std::tuple<std::uint64_t, std::size_t, std::size_t>& entry, std::uint64_t e){return std::get<0>(entry) < e;});
+    for (; change != changedSynapses.end(); change++){
+        const Synapse* synapse = getSynapse(std::get<1>(*change), std::get<2>(*change));
+        if (synapse && synapse->changedEpoch == std::get<0>(*change)) snapshot(*synapse, positions[neurons[synapse->pN].pos]);
+    }
+    return epoch;
 }
 
-std::vector<NeuCor::SynapseSnapshot> NeuCor::getSynapseSnapshots() const {
-    std::vector<SynapseSnapshot> snapshots;
+ArrayView<coord3> NeuCor::getPositionView() const {
+    return {positions.data(), positions.size(), sizeof(coord3)};
+}
 
-    for (const auto& neuron: neurons) {
-        for (const auto& synapse: neuron.outSynapses) {
-            snapshots.push_back({
-                synapse.pN,
-                synapse.tN,
-                getNeuron(synapse.pN)->position(),
-                getNeuron(synapse.tN)->position(),
-                synapse.getWeight(),
-                synapse.getPrePot(),
-                synapse.getPostPot(),
-                synapse.getWeight() < 0.0f,
-            });
+ArrayView<float> NeuCor::getPotentialView() const {
+    return {potAct.data(), potAct.size()/2, 2*sizeof(float)};
+}
+
+ArrayView<float> NeuCor::getActivityView() const {
+    return {potAct.data()+1, potAct.size()/2, 2*sizeof(float)};
+}
+
+NeuCor::SynapseView NeuCor::getSynapseView(){
+    if (packedVersion != topologyVersion){
+        packedWeights.clear();
+        packedEnds.clear();
+        for (auto &neuron: neurons){
+            for (auto &synapse: neuron.outSynapses){
+                if (synapse.deleted) continue;
+                synapse.packedIndex = packedWeights.size();
+                packedWeights.push_back(synapse.getWeight());
+                packedEnds.push_back(static_cast<std::uint32_t>(synapse.pN));
+                packedEnds.push_back(static_cast<std::uint32_t>(synapse.tN));
+            }
         }
+        packedVersion = topologyVersion;
+    }
+    else {
+        auto change = std::lower_bound(changedSynapses.begin(), changedSynapses.end(), packedEpoch,
+            [](const std::tuple<std::uint64_t, std::size_t, std::size_t>& entry, std::uint64_t e){return std::get<0>(entry) < e;});
+        for (; change != changedSynapses.end(); change++)
+            if (const Synapse* synapse = getSynapse(std::get<1>(*change), std::get<2>(*change)))
+                packedWeights[synapse->packedIndex] = synapse->getWeight();
     }
+    packedEpoch = epoch;
 
-    return snapshots;
+    SynapseView view;
+    view.weights = {packedWeights.data(), packedWeights.size(), sizeof(float)};
+    view.fromIDs = {packedEnds.data(), packedWeights.size(), 2*sizeof(std::uint32_t)};
+    view.toIDs = {packedEnds.data()+1, packedWeights.size(), 2*sizeof(std::uint32_t)};
+    view.topologyVersion = topologyVersion;
+    return view;
+}
+
+void NeuCor::markChanged(Neuron& neuron){
+    neuron.changedEpoch = epoch;
+    changedNeurons.emplace_back(epoch, neuron.getID());
+    if (2*neurons.size() + 64 < changedNeurons.size()) compactChanges();
+}
+
+void NeuCor::markChanged(Synapse& synapse){
+    synapse.changedEpoch = epoch;
+    changedSynapses.emplace_back(epoch, synapse.pN, synapse.tN);
+    if (2*synapseCount + 64 < changedSynapses.size()) compactChanges();
+}
+
+void NeuCor::markAllChanged(){
+    rebuiltEpoch = epoch;
+    changedNeurons.clear();
+    changedSynapses.clear();
+}
+
+void NeuCor::compactChanges(){
+    // Every object keeps at most its latest entry, so the logs stay within the size of the network
+    changedNeurons.erase(std::remove_if(changedNeurons.begin(), changedNeurons.end(),
+        [this](const std::pair<std::uint64_t, std::size_t>& entry){
+            return neurons.size() <= entry.second || neurons[entry.second].changedEpoch != entry.first;
+        }), changedNeurons.end());
+    changedSynapses.erase(std::remove_if(changedSynapses.begin(), changedSynapses.end(),
+        [this](const std::tuple<std::uint64_t, std::size_t, std::size_t>& entry){
+            const Synapse* synapse = std::get<1>(entry) < neurons.size() ? getSynapse(std::get<1>(entry), std::get<2>(entry)) : nullptr;
+            return !synapse || synapse->changedEpoch != std::get<0>(entry);
+        }), changedSynapses.end());
 }
 
 std::vector<NeuCor::InputSnapshot> NeuCor::getInputSnapshots() const {
@@ -151,7 +398,8 @@ std::vector<NeuCor::InputSnapshot> NeuCor::getInputSnapshots() const {
     return snapshots;
 }
 
-void NeuCor::createNeuron(coord3 position){
+NeuCor::NeuronHandle NeuCor::createNeuron(coord3 position, unsigned type){
+    assert(type < neuronTypes.size());
     #define SPAWN_DENSITY 8
     #define SPAWN_SIZE 2.0
     #define SPAWN_SPHERE true
@@ -175,21 +423,232 @@ void NeuCor::createNeuron(coord3 position){
         position.z = (randomUnit()-0.5f)*spawnSize;
     }
 
+    std::size_t const ID = getFreeID();
     if (freeNeuronIDs.size() == 0 || false){
-        neurons.emplace_back(this, position);
+        neurons.emplace_back(this, position, type);
     }
     else {
-        Neuron newNeuron(this, position);
+        Neuron newNeuron(this, position, type);
         neurons.at(freeNeuronIDs.back()) = newNeuron;
         freeNeuronIDs.pop_back();
+        deletedNeurons--;
+    }
+    return getNeuronHandle(ID);
+}
+
+namespace {
+// Random streams of bulk construction, each seeded from the network seed, a purpose and an index (splitmix64, like NeuCor::random()).
+// Work is split into fixed chunks with their own streams, so the result doesn't depend on how many threads do it
+struct RandomStream {
+    std::uint64_t state;
+    RandomStream(std::uint64_t seed, std::uint64_t purpose, std::uint64_t index): state(mix(seed ^ mix(purpose*0x9E3779B97F4A7C15ull + index))) {}
+    static std::uint64_t mix(std::uint64_t z){
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+    std::uint32_t next(){return static_cast<std::uint32_t>(mix(state += 0x9E3779B97F4A7C15ull) >> 32);}
+    float unit(){return static_cast<float>(next() >> 8) * (1.0f/16777215.0f);} // As NeuCor::randomUnit()
+};
+
+std::uint32_t spreadBits(std::uint32_t v){ // Inserts two zero bits between each of the lowest 10 bits
+    v &= 0x3FF;
+    v = (v | (v << 16)) & 0x030000FF;
+    v = (v | (v <<  8)) & 0x0300F00F;
+    v = (v | (v <<  4)) & 0x030C30C3;
+    v = (v | (v <<  2)) & 0x09249249;
+    return v;
+}
+
+// Morton code of a position in the box [low, high], 10 bits per axis. Neurons are numbered in this order, see renumberNeurons()
+std::uint32_t mortonCode(const coord3& p, const coord3& low, const coord3& high){
+    auto quantise = [](float v, float lo, float hi) -> std::uint32_t {
+        return hi <= lo ? 0 : static_cast<std::uint32_t>(fminf(1023.0f, 1024.0f*(v - lo)/(hi - lo)));
+    };
+    return spreadBits(quantise(p.x, low.x, high.x)) | spreadBits(quantise(p.y, low.y, high.y)) << 1 | spreadBits(quantise(p.z, low.z, high.z)) << 2;
+}
+
+// Calls work(begin, end) for the chunks of [0, count), on up to the given number of threads
+void parallelChunks(std::size_t count, std::size_t chunkSize, unsigned threads, const std::function<void(std::size_t, std::size_t)>& work){
+    std::size_t const chunks = (count + chunkSize - 1)/chunkSize;
+    std::atomic<std::size_t> nextChunk(0);
+    auto worker = [&](){
+        for (std::size_t c = nextChunk++; c < chunks; c = nextChunk++) work(c*chunkSize, std::min(count, (c+1)*chunkSize));
+    };
+#ifdef __EMSCRIPTEN__
+    threads = 1; // The browser build has no threads
+#endif
+    std::vector<std::thread> pool;
+    for (std::size_t t = 1; t < std::min<std::size_t>(threads, chunks); t++) pool.emplace_back(worker);
+    worker();
+    for (auto &thread: pool) thread.join();
+}
+}
+
+void NeuCor::generateBulk(int n_neurons, unsigned threads){
+    assert(0 <= n_neurons && std::size_t(n_neurons) <= UINT32_MAX && neurons.empty() && positions.empty());
+    if (threads == 0) threads = std::max(1u, std::thread::hardware_concurrency());
+    std::size_t const n = n_neurons;
+    std::uint64_t const seed = rngState;
+    std::size_t const chunkSize = 4096;
+
+    // Positions, uniform in a sphere of the same density as createNeuron() gives
+    float const spawnSize = powf(n/(1.3333*3.1459*SPAWN_DENSITY),0.33333)*2.0;
+    std::vector<coord3> spawned(n);
+    parallelChunks(n, chunkSize, threads, [&](std::size_t begin, std::size_t end){
+        RandomStream random(seed, 1, begin/chunkSize);
+        for (std::size_t i = begin; i<end; i++){
+            coord3 p;
+            do {
+                p = {(random.unit()-0.5f)*spawnSize, (random.unit()-0.5f)*spawnSize, (random.unit()-0.5f)*spawnSize};
+            } while (spawnSize*spawnSize/4.0f < p.x*p.x + p.y*p.y + p.z*p.z);
+            spawned[i] = p;
+        }
+    });
+
+    // Created in the order renumberNeurons() would give them, which then has nothing to move
+    coord3 low = {INFINITY, INFINITY, INFINITY}, high = {-INFINITY, -INFINITY, -INFINITY};
+    for (const coord3& p: spawned){
+        low = {fminf(low.x, p.x), fminf(low.y, p.y), fminf(low.z, p.z)};
+        high = {fmaxf(high.x, p.x), fmaxf(high.y, p.y), fmaxf(high.z, p.z)};
     }
+    std::vector<std::pair<std::uint32_t, std::uint32_t>> order(n); // (Morton code, spawn index)
+    parallelChunks(n, chunkSize, threads, [&](std::size_t begin, std::size_t end){
+        for (std::size_t i = begin; i<end; i++) order[i] = {mortonCode(spawned[i], low, high), i};
+    });
+    std::sort(order.begin(), order.end()); // Ties by spawn index, as the stable sort of renumberNeurons()
+    // Only the slots are made here. The neurons are registered and initialized by chunk, and their containers are allocated from the chunk's arena
+    std::size_t const chunks = (n + chunkSize - 1)/chunkSize;
+    for (std::size_t c = 0; c<chunks; c++) bulkArenas.emplace_back();
+    for (std::size_t ID = 0; ID<n; ID++) neurons.emplace_back(this, ID, &bulkArenas[ID/chunkSize]);
+    positions.resize(n);
+    potAct.resize(2*n);
+    parallelChunks(n, chunkSize, threads, [&](std::size_t begin, std::size_t end){
+        for (std::size_t ID = begin; ID<end; ID++) positions[ID] = spawned[order[ID].second];
+    });
+    std::vector<std::pair<std::uint32_t, std::uint32_t>>().swap(order);
+    std::vector<coord3>().swap(spawned);
+
+    // Neighbours are searched in a grid of cells as wide as the connection distance (1), so only the 27 cells around a neuron are checked
+    auto cellOf = [](float v, float lo) -> std::size_t {return static_cast<std::size_t>(v - lo);};
+    std::size_t const dimX = n == 0 ? 0 : cellOf(high.x, low.x) + 1, dimY = n == 0 ? 0 : cellOf(high.y, low.y) + 1, dimZ = n == 0 ? 0 : cellOf(high.z, low.z) + 1;
+    auto cellIndex = [&](const coord3& p){return (cellOf(p.z, low.z)*dimY + cellOf(p.y, low.y))*dimX + cellOf(p.x, low.x);};
+    std::vector<std::size_t> cellStart(dimX*dimY*dimZ + 1, 0);
+    std::vector<std::uint32_t> cellNeurons(n);
+    for (std::size_t ID = 0; ID<n; ID++) cellStart[cellIndex(positions[ID]) + 1]++;
+    for (std::size_t c = 1; c<cellStart.size(); c++) cellStart[c] += cellStart[c-1];
+    std::vector<std::size_t> cellFill(cellStart.begin(), cellStart.end()-1);
+    for (std::size_t ID = 0; ID<n; ID++) cellNeurons[cellFill[cellIndex(positions[ID])]++] = ID;
+
+    // Out synapses of every neuron, to all neurons closer than 1 unit (as Neuron::makeConnections()), in ascending target order
+    struct Connection {
+        std::uint32_t target;
+        float weight, length;
+    };
+    std::vector<std::vector<Connection>> found(chunks);
+    std::vector<std::uint32_t> outCount(n);
+    parallelChunks(n, chunkSize, threads, [&](std::size_t begin, std::size_t end){
+        std::vector<Connection>& connections = found[begin/chunkSize];
+        std::vector<std::uint32_t> near;
+        for (std::size_t ID = begin; ID<end; ID++){
+            const coord3 p = positions[ID];
+            std::size_t const x = cellOf(p.x, low.x), y = cellOf(p.y, low.y), z = cellOf(p.z, low.z);
+            near.clear();
+            for (std::size_t cz = z == 0 ? 0 : z-1; cz <= std::min(z+1, dimZ-1); cz++)
+            for (std::size_t cy = y == 0 ? 0 : y-1; cy <= std::min(y+1, dimY-1); cy++)
+            for (std::size_t cx = x == 0 ? 0 : x-1; cx <= std::min(x+1, dimX-1); cx++){
+                std::size_t const c = (cz*dimY + cy)*dimX + cx;
+                for (std::size_t k = cellStart[c]; k<cellStart[c+1]; k++){
+                    const coord3 q = positions[cellNeurons[k]];
+                    float const dx = q.x-p.x, dy = q.y-p.y, dz = q.z-p.z;
+                    if (cellNeurons[k] != ID && dx*dx + dy*dy + dz*dz < 1.0f) near.push_back(cellNeurons[k]);
+                }
+            }
+            std::sort(near.begin(), near.end());
+
+            RandomStream random(seed, 2, ID);
+            for (std::uint32_t target: near){
+                float weight = random.unit()*0.8f + 0.2f; // As the Synapse constructor
+                if (random.unit() < 0.2f) weight = -weight;
+                connections.push_back({target, weight, p.getDist(positions[target])});
+            }
+            outCount[ID] = near.size();
+        }
+    });
+
+    // Assembly, by chunk, each neuron from its own connections only. Synapse generations follow the (parent, target) order, whatever thread builds them.
+    // Connections go both ways (the distance is symmetric), so the in synapses of a neuron come from its out synapse targets,
+    // which are already in ascending order, the map order
+    std::vector<std::size_t> outStart(n + 1, 0);
+    for (std::size_t ID = 0; ID<n; ID++) outStart[ID+1] = outStart[ID] + outCount[ID];
+    std::uint32_t const firstGeneration = synapseGenerations + 1;
+    std::vector<double> chunkWeights(chunks, 0.0);
+    parallelChunks(n, chunkSize, threads, [&](std::size_t begin, std::size_t end){
+        const Connection* c = found[begin/chunkSize].data();
+        for (std::size_t ID = begin; ID<end; ID++){
+            Neuron& neuron = neurons[ID];
+            neuron.initialize();
+            neuron.outSynapses.reserve(outCount[ID]);
+            for (std::uint32_t k = 0; k<outCount[ID]; k++, c++){
+                neuron.outSynapses.emplace_back(this, ID, c->target, c->weight, c->length, firstGeneration + outStart[ID] + k);
+                neuron.inSynapses.emplace_hint(neuron.inSynapses.end(), c->target, ID);
+                chunkWeights[begin/chunkSize] += c->weight;
+            }
+        }
+        std::vector<Connection>().swap(found[begin/chunkSize]); // Frees the candidates as they are used
+    });
+    for (double weight: chunkWeights) weightSum += weight; // In chunk order, so the sum doesn't depend on the threads either
+    synapseGenerations += outStart[n];
+    synapseCount += outStart[n];
+    markAllChanged(); // The neurons and synapses were made without log entries
+    topologyVersion++;
+
+    reserveSimulationQueue();
+    publishCounters();
+}
+
+unsigned NeuCor::addNeuronType(const NeuronType& type){
+    assert(neuronTypes.size() <= UINT16_MAX);
+    neuronTypes.push_back(type);
+    typeTables.resize(neuronTypes.size());
+    updateTypeTables(neuronTypes.size()-1, StandardModel::waveform(type));
+    return neuronTypes.size()-1;
+}
+
+const NeuronType& NeuCor::getNeuronType(unsigned type) const {
+    return neuronTypes.at(type);
+}
+
+void NeuCor::setNeuronType(unsigned type, const NeuronType& parameters){
+    neuronTypes.at(type) = parameters;
+    updateTypeTables(type, StandardModel::waveform(parameters));
+}
+
+void NeuCor::updateTypeTables(unsigned type, const APWaveform& apWaveform){
+    typeTables.at(type).apWaveform = apWaveform;
+    typeTables.at(type).fixedAPWaveform = FixedAPWaveform(apWaveform, FixedPoint::potentialBits);
+}
+
+unsigned NeuCor::getNeuronTypeCount() const {
+    return neuronTypes.size();
+}
+
+void NeuCor::assignNeuronType(std::size_t neuronID, unsigned type){
+    assert(type < neuronTypes.size());
+    Neuron* neu = getNeuron(neuronID);
+    neu->run(); // Brought up to now with the old parameters
+    neu->type = type;
 }
 void NeuCor::createSynapse(std::size_t toID, std::size_t fromID, float weight){
 
     for (auto &t: neurons.at(fromID).outSynapses) // Don't allow if synapse already exists
-        if (t.tN == toID)
+        if (t.tN == toID && !t.deleted)
             return;
 
+    if (!isQuiet(neurons.at(fromID))){ // Growing the vector could move synapses which queued events point to
+        pendingSynapses.emplace_back(fromID, toID, weight);
+        return;
+    }
     neurons.at(fromID).outSynapses.emplace_back(this, fromID, toID);
     neurons.at(fromID).outSynapses.back().setWeight(weight);
 }
@@ -222,10 +681,306 @@ std::size_t NeuCor::getFreeID() const {
     else return freeNeuronIDs.back();
 }
 
-float NeuCor::getTime() const {return currentTime;}
+double NeuCor::getTime() const {return double(currentTick)*msPerTick;}
+tick_t NeuCor::getTicks() const {return currentTick;}
+std::int64_t NeuCor::getTimeResolution() const {return ticksPerMs;}
+
+NeuCor::neuronModels NeuCor::getNeuronModel() const {return neuronModel;}
+
+bool NeuCor::setNeuronModel(neuronModels model){
+    if (currentTick != 0 || !simulationQueue.empty()) return false;
+    switch (model){
+        case NEURON_MODEL_STANDARD:
+            if (fixedPoint) setNeuronKernels<FixedStandardModel>();
+            else setNeuronKernels<StandardModel>();
+            neuronInitializer = &StandardModel::initialize;
+            break;
+        case NEURON_MODEL_LIF:
+            if (fixedPoint) setNeuronKernels<FixedLIFModel>();
+            else setNeuronKernels<LIFModel>();
+            neuronInitializer = &LIFModel::initialize;
+            break;
+        case NEURON_MODEL_IZHIKEVICH:
+            if (fixedPoint) return false;
+            setNeuronKernels<IzhikevichModel>();
+            neuronInitializer = &IzhikevichModel::initialize;
+            break;
+        default:
+            return false;
+    }
+    neuronModel = model;
+    setDrainKernel();
+    for (auto &neu: neurons) if (!neu.isDeleted()) neuronInitializer(neu, neu.parameters());
+    return true;
+}
+
+template <typename Model>
+void NeuCor::setNeuronKernels(){
+    neuronKernel = &Neuron::kernel<Model>;
+}
+
+void NeuCor::setDrainKernel(){
+    switch (neuronModel){
+        case NEURON_MODEL_STANDARD:
+            if (fixedPoint) setDrainKernel<FixedStandardModel>();
+            else setDrainKernel<StandardModel>();
+            break;
+        case NEURON_MODEL_LIF:
+            if (fixedPoint) setDrainKernel<FixedLIFModel>();
+            else setDrainKernel<LIFModel>();
+            break;
+        case NEURON_MODEL_IZHIKEVICH:
+            setDrainKernel<IzhikevichModel>();
+            break;
+        default:
+            assert(false);
+    }
+}
+
+// Fixed point models are only combined with fixed point rules (see setFixedPoint())
+template <typename Model>
+void NeuCor::setDrainKernel(){
+    constexpr bool fixed = std::is_base_of<FixedPoint, Model>::value;
+    switch (plasticityRule){
+        case PLASTICITY_TRACE:
+            drainKernel = &NeuCor::drain<Model, std::conditional_t<fixed, FixedTraceRule, TraceRule>>;
+            break;
+        case PLASTICITY_NEAREST_ADDITIVE:
+            drainKernel = &NeuCor::drain<Model, std::conditional_t<fixed, FixedNearestSpikeRule<false>, NearestSpikeRule<false>>>;
+            break;
+        case PLASTICITY_NEAREST_MULTIPLICATIVE:
+            drainKernel = &NeuCor::drain<Model, std::conditional_t<fixed, FixedNearestSpikeRule<true>, NearestSpikeRule<true>>>;
+            break;
+        case PLASTICITY_TRIPLET:
+            drainKernel = &NeuCor::drain<Model, std::conditional_t<fixed, FixedTripletRule, TripletRule>>;
+            break;
+        default:
+            assert(false);
+    }
+}
+
+NeuCor::plasticityRules NeuCor::getPlasticityRule() const {return plasticityRule;}
+
+void NeuCor::setPlasticityRule(plasticityRules rule){
+    switch (rule){
+        case PLASTICITY_TRACE:
+            if (fixedPoint) setPlasticityKernels<FixedTraceRule>();
+            else setPlasticityKernels<TraceRule>();
+            break;
+        case PLASTICITY_NEAREST_ADDITIVE:
+            if (fixedPoint) setPlasticityKernels<FixedNearestSpikeRule<false>>();
+            else setPlasticityKernels<NearestSpikeRule<false>>();
+            break;
+        case PLASTICITY_NEAREST_MULTIPLICATIVE:
+            if (fixedPoint) setPlasticityKernels<FixedNearestSpikeRule<true>>();
+            else setPlasticityKernels<NearestSpikeRule<true>>();
+            break;
+        case PLASTICITY_TRIPLET:
+            if (fixedPoint) setPlasticityKernels<FixedTripletRule>();
+            else setPlasticityKernels<TripletRule>();
+            break;
+        default:
+            assert(false);
+            return;
+    }
+    plasticityRule = rule;
+    setDrainKernel();
+}
+
+template <typename Rule>
+void NeuCor::setPlasticityKernels(){
+    presynapticKernel = &Synapse::presynapticPlasticity<Rule>, firingKernel = &Neuron::firing<Rule>;
+}
+
+bool NeuCor::setFixedPoint(bool enable){
+    if (currentTick != 0 || !simulationQueue.empty()) return false;
+    if (enable && neuronModel == NEURON_MODEL_IZHIKEVICH) return false;
+    fixedPoint = enable;
+    setNeuronModel(neuronModel);
+    setPlasticityRule(plasticityRule);
+    return true;
+}
+
+bool NeuCor::isFixedPoint() const {return fixedPoint;}
+
+bool NeuCor::setTimeResolution(std::int64_t newTicksPerMs){
+    assert(0 < newTicksPerMs);
+    if (newTicksPerMs <= 0 || currentTick != 0 || !simulationQueue.empty()) return false;
+
+    // Before anything has run, the only non-zero times are input offsets
+    for (auto &inFi: inputHandler) inFi.lastFire = inFi.lastFire*newTicksPerMs/ticksPerMs;
+    ticksPerMs = newTicksPerMs;
+    msPerTick = 1.0/double(newTicksPerMs);
+    return true;
+}
+
+bool NeuCor::isDeterministic() const {return deterministic;}
+
+std::uint32_t NeuCor::random(){
+    if (!deterministic) return static_cast<std::uint32_t>(rand());
+
+    // splitmix64, which gives the same sequence on every platform
+    std::uint64_t z = (rngState += 0x9E3779B97F4A7C15ull);
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    return static_cast<std::uint32_t>((z ^ (z >> 31)) >> 32);
+}
+
+float NeuCor::randomUnit(){
+    if (!deterministic) return static_cast<float>(rand()) / static_cast<float>(RAND_MAX);
+    return static_cast<float>(random() >> 8) * (1.0f/16777215.0f);
+}
+
+void NeuCor::setPerfProfile(PerfProfile* profile){
+    perfProfile = profile;
+}
+std::uint64_t NeuCor::getEventCount() const {return eventCount;}
+const NeuCor::Counters& NeuCor::getCounters() const {return counters;}
+
+void NeuCor::setFlightRecorder(FlightRecorder* recorder){
+    flightRecorder = recorder;
+}
+
+void NeuCor::setPublisher(GenerationPublisher* newPublisher){
+    publisher = newPublisher;
+}
+
+void NeuCor::recordEvent(const simulator* s, float weightDelta){
+    switch (s->type){
+        case simulator::SIMULATOR_NEURON:
+            flightRecorder->record(FlightRecorder::EVENT_NEURON, static_cast<const Neuron*>(s)->getID(), getTime(), weightDelta);
+            break;
+        case simulator::SIMULATOR_SYNAPSE: {
+            const Synapse* syn = static_cast<const Synapse*>(s);
+            flightRecorder->record(FlightRecorder::EVENT_SYNAPSE, syn->tN, getTime(), weightDelta, syn->pN);
+            break;
+        }
+        case simulator::SIMULATOR_INPUT:
+            flightRecorder->record(FlightRecorder::EVENT_INPUT, static_cast<const InputFirer*>(s) - inputHandler.data(), getTime(), weightDelta);
+            break;
+        default:
+            flightRecorder->record(FlightRecorder::EVENT_OTHER, 0, getTime(), weightDelta);
+    }
+}
+
+void NeuCor::countSpike(Neuron& neuron){
+    spikeCount++;
+    if (!spikeObservers.empty()) spikeBatch.push_back({getTime(), neuron.getID()});
+    rollActivityWindow();
+    if (neuron.lastActivityWindow != activityWindowIndex){
+        neuron.lastActivityWindow = activityWindowIndex;
+        activeInWindow++;
+    }
+}
+
+void NeuCor::rollActivityWindow(){
+    std::int64_t const window = currentTick/toTicks(activityWindow);
+    if (window == activityWindowIndex) return;
+
+    activeInLastWindow = window == activityWindowIndex+1 ? activeInWindow : 0;
+    activeInWindow = 0;
+    activityWindowIndex = window;
+}
+
+void NeuCor::publishCounters(){
+    rollActivityWindow();
+
+    counters.time.store(getTime(), std::memory_order_relaxed);
+    counters.events.store(eventCount, std::memory_order_relaxed);
+    counters.spikes.store(spikeCount, std::memory_order_relaxed);
+    counters.queueDepth.store(simulationQueue.size(), std::memory_order_relaxed);
+    counters.neurons.store(neurons.size() - deletedNeurons, std::memory_order_relaxed);
+    counters.synapses.store(synapseCount, std::memory_order_relaxed);
+    counters.meanWeight.store(synapseCount != 0 ? float(weightSum/double(synapseCount)) : 0.0f, std::memory_order_relaxed);
+    counters.activeNeurons.store(activeInLastWindow, std::memory_order_relaxed);
+}
+
+namespace {
+std::vector<bool> observedNeurons(const std::vector<std::size_t>& neuronIDs){
+    std::vector<bool> observed;
+    for (std::size_t id: neuronIDs){
+        if (observed.size() <= id) observed.resize(id+1, false);
+        observed[id] = true;
+    }
+    return observed;
+}
+
+bool observes(const std::vector<bool>& observed, std::size_t id){
+    return id < observed.size() && observed[id];
+}
+
+template <typename Subscriptions, typename Event, typename Filter>
+void deliver(Subscriptions& subscriptions, std::vector<Event>& batch, Filter observed){
+    if (batch.empty()) return;
+    for (auto &subscription: subscriptions){
+        if (subscription.neurons.empty()){
+            subscription.observer(batch.data(), batch.size());
+            continue;
+        }
+        subscription.filtered.clear();
+        for (const Event &event: batch)
+            if (observed(subscription.neurons, event)) subscription.filtered.push_back(event);
+        if (!subscription.filtered.empty()) subscription.observer(subscription.filtered.data(), subscription.filtered.size());
+    }
+    batch.clear();
+}
+}
+
+unsigned NeuCor::addSpikeObserver(SpikeObserver observer, const std::vector<std::size_t>& neuronIDs){
+    spikeObservers.push_back({++observerHandles, std::move(observer), observedNeurons(neuronIDs), {}});
+    return observerHandles;
+}
+
+unsigned NeuCor::addWeightObserver(WeightObserver observer, const std::vector<std::size_t>& neuronIDs){
+    weightObservers.push_back({++observerHandles, std::move(observer), observedNeurons(neuronIDs), {}});
+    return observerHandles;
+}
+
+void NeuCor::removeObserver(unsigned handle){
+    spikeObservers.erase(std::remove_if(spikeObservers.begin(), spikeObservers.end(),
+        [handle](const Subscription<SpikeObserver, SpikeEvent>& s){return s.handle == handle;}), spikeObservers.end());
+    weightObservers.erase(std::remove_if(weightObservers.begin(), weightObservers.end(),
+        [handle](const Subscription<WeightObserver, WeightEvent>& s){return s.handle == handle;}), weightObservers.end());
+    if (spikeObservers.empty()) spikeBatch.clear();
+    if (weightObservers.empty()) weightBatch.clear();
+}
+
+void NeuCor::recordWeight(const Synapse& synapse){
+    weightBatch.push_back({getTime(), synapse.pN, synapse.tN, synapse.getWeight()});
+}
+
+void NeuCor::deliverObservations(){
+    deliver(spikeObservers, spikeBatch, [](const std::vector<bool>& observed, const SpikeEvent& spike){
+        return observes(observed, spike.id);
+    });
+    deliver(weightObservers, weightBatch, [](const std::vector<bool>& observed, const WeightEvent& change){
+        return observes(observed, change.fromID) || observes(observed, change.toID);
+    });
+}
 
 void NeuCor::queueSimulation(simulator* s, const float time){
-    simulationQueue.emplace(s, currentTime + time);
+    queueSimulationAt(s, currentTick + toTicks(time));
+}
+
+void NeuCor::queueSimulationAt(simulator* s, const tick_t time){
+    if (!deterministic){
+        simulationQueue.emplace(s, time, s->generation);
+        return;
+    }
+
+    std::uint64_t target = 0;
+    switch (s->type){
+        case simulator::SIMULATOR_NEURON: target = static_cast<const Neuron*>(s)->getID(); break;
+        case simulator::SIMULATOR_SYNAPSE: { // Target neuron first, then parent neuron (28 bits each)
+            const Synapse* syn = static_cast<const Synapse*>(s);
+            target = (std::uint64_t(syn->tN) << 28) | std::uint64_t(syn->pN & 0xFFFFFFF);
+            break;
+        }
+        case simulator::SIMULATOR_INPUT: target = static_cast<const InputFirer*>(s) - inputHandler.data(); break;
+        default: break;
+    }
+    const std::uint64_t order = (std::uint64_t(s->type) << 56) | (target & 0xFFFFFFFFFFFFFFull);
+    simulationQueue.emplace(s, time, s->generation, order, queueSequence++);
 }
 void NeuCor::queFlip(std::pair<std::size_t, std::size_t> ID){
     synapseFlippingQueue.push_back(ID);
@@ -243,14 +998,14 @@ const Neuron* NeuCor::getNeuron(std::size_t ID) const {
 
 Synapse* NeuCor::getSynapse(std::size_t fromID, std::size_t toID){
     for (size_t i = 0; i<getNeuron(fromID)->outSynapses.size(); i++)
-        if (getNeuron(fromID)->outSynapses.at(i).tN == toID)
+        if (getNeuron(fromID)->outSynapses.at(i).tN == toID && !getNeuron(fromID)->outSynapses.at(i).deleted)
             return &getNeuron(fromID)->outSynapses.at(i);
 
     return nullptr;
 }
 const Synapse* NeuCor::getSynapse(std::size_t fromID, std::size_t toID) const{
     for (std::size_t i = 0; i < getNeuron(fromID)->outSynapses.size(); i++)
-        if (getNeuron(fromID)->outSynapses.at(i).tN == toID)
+        if (getNeuron(fromID)->outSynapses.at(i).tN == toID && !getNeuron(fromID)->outSynapses.at(i).deleted)
             return &getNeuron(fromID)->outSynapses.at(i);
 
     return nullptr;
@@ -264,48 +1019,225 @@ const Synapse* NeuCor::getSynapse(std::pair<std::size_t, std::size_t> ID) const{
 
 void NeuCor::deleteNeuron(std::size_t ID){
     Neuron* n = getNeuron(ID);
+    if (n->deleted) return;
+    n->deleted = true;
+    n->generation++;
+    deletedNeurons++;
 
     coord3 emptyPos;
     emptyPos.setNAN();
     n->setPosition(emptyPos);
 
-    //Delete owned synapses backwards iterating for loop
-    for (std::vector<Synapse>::reverse_iterator syn = n->outSynapses.rbegin(); syn != n->outSynapses.rend(); ++syn){
-        deleteSynapse(syn->pN, syn->tN);
-    }
-    n->outSynapses.clear();
+    for (auto &syn: n->outSynapses)
+        if (!syn.deleted) tombstoneSynapse(syn);
 
-    //Delete input owned synapses using backwards iterating for loop
-    for (auto syn = n->inSynapses.rbegin(); syn != n->inSynapses.rend();){
-        deleteSynapse(syn->first, syn->second);
+    while (!n->inSynapses.empty()){
+        std::size_t const fromID = n->inSynapses.begin()->first;
+        if (Synapse* syn = getSynapse(fromID, ID)) tombstoneSynapse(*syn); // Also removes it from inSynapses
+        else n->inSynapses.erase(fromID);
     }
-    n->inSynapses.clear();
-
-    freeNeuronIDs.push_back(ID);
+    queueCompaction(*n); // The ID is freed once the out synapses are compacted
 }
 
 void NeuCor::deleteSynapse(std::size_t fromID, std::size_t toID){
-    for (int i = 0; i<getNeuron(fromID)->outSynapses.size(); i++){
-        if (getNeuron(fromID)->outSynapses.at(i).tN == toID){
+    if (Synapse* syn = getSynapse(fromID, toID)) tombstoneSynapse(*syn);
+}
 
-            getNeuron(fromID)->outSynapses.erase(getNeuron(fromID)->outSynapses.begin()+i);
-            getNeuron(toID)->removeInSyn(fromID);
-            return;
+void NeuCor::tombstoneSynapse(Synapse& synapse){
+    synapse.deleted = true;
+    if (synapse.AP_fireTime <= currentTick) synapse.AP_fireTime = 0; // Delivered; the target no longer integrates it. Otherwise cleared by Synapse::run()
+    weightSum -= synapse.getWeight();
+    synapseCount--;
+    topologyVersion++;
+    getNeuron(synapse.tN)->removeInSyn(synapse.pN);
+    queueCompaction(*getNeuron(synapse.pN));
+}
+
+void NeuCor::queueCompaction(Neuron& neuron){
+    if (neuron.compactionQueued) return;
+    neuron.compactionQueued = true;
+    compactionQueue.push_back(neuron.getID());
+}
+
+bool NeuCor::isQuiet(const Neuron& neuron) const {
+    for (const auto &syn: neuron.outSynapses)
+        if (currentTick < syn.AP_fireTime) return false;
+    return true;
+}
+
+void NeuCor::compactStructure(){
+    // Flips, removals and creations move synapses within or between vectors, which is only safe while
+    // none of the synapses involved has a queued delivery. Whatever can't be done yet is kept for a later step.
+    std::size_t kept = 0;
+    for (auto &flip: synapseFlippingQueue){
+        Synapse* synapse = getSynapse(flip);
+        if (!synapse) continue;
+        if (isQuiet(*getNeuron(flip.first)) && isQuiet(*getNeuron(flip.second))) synapse->flipDirection();
+        else synapseFlippingQueue[kept++] = flip;
+    }
+    synapseFlippingQueue.resize(kept);
+
+    kept = 0;
+    for (std::size_t ID: compactionQueue){
+        Neuron& neuron = neurons[ID];
+        if (!isQuiet(neuron)){
+            compactionQueue[kept++] = ID;
+            continue;
         }
+        neuron.outSynapses.erase(std::remove_if(neuron.outSynapses.begin(), neuron.outSynapses.end(),
+            [](const Synapse& syn){return syn.deleted;}), neuron.outSynapses.end());
+        neuron.compactionQueued = false;
+        if (neuron.deleted) freeNeuronIDs.push_back(ID);
+    }
+    compactionQueue.resize(kept);
+
+    if (pendingSynapses.empty()) return;
+    std::vector<std::tuple<std::size_t, std::size_t, float>> pending;
+    pending.swap(pendingSynapses);
+    for (auto &creation: pending){
+        if (neurons.at(std::get<0>(creation)).deleted || neurons.at(std::get<1>(creation)).deleted) continue;
+        createSynapse(std::get<1>(creation), std::get<0>(creation), std::get<2>(creation)); // Deferred again unless quiet
     }
 }
 
-simulator::simulator(NeuCor* p){
+std::vector<std::size_t> NeuCor::renumberNeurons(){
+    std::size_t const n = neurons.size();
+    coord3 low = {INFINITY, INFINITY, INFINITY}, high = {-INFINITY, -INFINITY, -INFINITY};
+    for (const auto &neu: neurons){
+        if (neu.deleted) continue;
+        const coord3 p = positions[neu.pos];
+        low = {fminf(low.x, p.x), fminf(low.y, p.y), fminf(low.z, p.z)};
+        high = {fmaxf(high.x, p.x), fmaxf(high.y, p.y), fmaxf(high.z, p.z)};
+    }
+
+    std::vector<std::pair<std::uint32_t, std::size_t>> order; // (Morton code, old ID)
+    order.reserve(n);
+    for (const auto &neu: neurons)
+        order.emplace_back(neu.deleted ? UINT32_MAX : mortonCode(positions[neu.pos], low, high), neu.getID());
+    std::stable_sort(order.begin(), order.end(),
+        [](const std::pair<std::uint32_t, std::size_t>& a, const std::pair<std::uint32_t, std::size_t>& b){return a.first < b.first;});
+
+    std::vector<std::size_t> newIDs(n);
+    bool identity = true;
+    for (std::size_t i = 0; i<n; i++){
+        newIDs[order[i].second] = i;
+        identity = identity && order[i].second == i;
+    }
+    if (identity) return newIDs;
+
+    if (stimulusQueue) drainStimuli(); // So that every pending stimulus is translated below
+    auto renumber = [&](std::size_t& ID){ID = newIDs[ID];};
+
+    // Queued events point to neurons and synapses, which all move. Remember what they point to by ID
+    struct queuedEvent {
+        simulation entry;
+        simulator::simulatorType type;   // The old neurons and synapses are gone when these are queued again
+        std::size_t parent, target;      // Neuron ID, or synapse parent and target IDs
+        std::uint32_t generation;        // Synapse generation, to find tombstoned synapses too
+    };
+    std::vector<queuedEvent> queued;
+    queued.reserve(simulationQueue.size());
+    for (; !simulationQueue.empty(); simulationQueue.pop()){
+        const simulation& entry = simulationQueue.top();
+        if (entry.generation != entry.addr->generation) continue; // Stale anyway
+        queuedEvent event = {entry, entry.addr->type, 0, 0, 0};
+        if (entry.addr->type == simulator::SIMULATOR_NEURON) event.parent = newIDs[static_cast<const Neuron*>(entry.addr)->getID()];
+        else if (entry.addr->type == simulator::SIMULATOR_SYNAPSE){
+            const Synapse* syn = static_cast<const Synapse*>(entry.addr);
+            event.parent = newIDs[syn->pN], event.target = newIDs[syn->tN], event.generation = syn->generation;
+        }
+        queued.push_back(event);
+    }
+
+    std::deque<Neuron> renumbered;
+    std::vector<coord3> newPositions(positions.size());
+    std::vector<float> newPotAct(potAct.size());
+    for (std::size_t i = 0; i<n; i++){
+        const Neuron& old = neurons[order[i].second];
+        newPositions[i] = positions[old.pos];
+        newPotAct[2*i] = potAct[old.PA], newPotAct[2*i+1] = potAct[old.PA+1];
+        renumbered.push_back(old);
+
+        Neuron& neu = renumbered.back();
+        neu.ownID = i, neu.pos = i, neu.PA = 2*i;
+        neu.generation++; // Old handles refer to the old IDs
+        for (auto &syn: neu.outSynapses) renumber(syn.pN), renumber(syn.tN);
+        Neuron::InSynapseMap inSynapses(neu.inSynapses.get_allocator());
+        for (const auto &in: neu.inSynapses) inSynapses.emplace(newIDs[in.first], newIDs[in.second]);
+        neu.inSynapses.swap(inSynapses);
+    }
+    neurons.swap(renumbered);
+    renumbered.clear();
+    positions.swap(newPositions);
+    potAct.swap(newPotAct);
+
+    for (auto &event: queued){
+        simulator* addr = event.entry.addr;
+        if (event.type == simulator::SIMULATOR_NEURON) addr = &neurons[event.parent];
+        else if (event.type == simulator::SIMULATOR_SYNAPSE){
+            addr = nullptr;
+            for (auto &syn: neurons[event.parent].outSynapses)
+                if (syn.tN == event.target && syn.generation == event.generation) addr = &syn;
+        }
+        if (addr) queueSimulationAt(addr, event.entry.stime);
+    }
+
+    for (auto &input: inputHandler) for (auto &ID: input.near) renumber(ID);
+    for (auto &detector: voltageDetectors) for (auto &ID: detector.near) renumber(ID);
+    for (auto &ID: freeNeuronIDs) renumber(ID);
+    for (auto &ID: compactionQueue) renumber(ID);
+    clockDriven.clear();
+    for (auto &neu: neurons) if (neu.clockDriven) clockDriven.push_back(neu.getID());
+    for (auto &flip: synapseFlippingQueue) renumber(flip.first), renumber(flip.second);
+    for (auto &creation: pendingSynapses) renumber(std::get<0>(creation)), renumber(std::get<1>(creation));
+    if (stimulusInjector) stimulusInjector->renumber(newIDs);
+
+    auto renumberFilter = [&](std::vector<bool>& observed){
+        std::vector<bool> filter(observed.empty() ? 0 : n, false);
+        for (std::size_t ID = 0; ID<observed.size() && ID<n; ID++) if (observed[ID]) filter[newIDs[ID]] = true;
+        observed.swap(filter);
+    };
+    for (auto &subscription: spikeObservers) renumberFilter(subscription.neurons);
+    for (auto &subscription: weightObservers) renumberFilter(subscription.neurons);
+
+    markAllChanged(); // Everything has a new ID, so incremental snapshots get everything again
+    topologyVersion++;
+    return newIDs;
+}
+
+NeuCor::NeuronHandle NeuCor::getNeuronHandle(std::size_t ID) const {
+    return {static_cast<std::uint32_t>(ID), getNeuron(ID)->generation};
+}
+
+NeuCor::SynapseHandle NeuCor::getSynapseHandle(std::size_t fromID, std::size_t toID) const {
+    const Synapse* synapse = getSynapse(fromID, toID);
+    return {static_cast<std::uint32_t>(fromID), static_cast<std::uint32_t>(toID), synapse ? synapse->generation : 0};
+}
+
+bool NeuCor::isAlive(NeuronHandle handle) const {
+    if (neurons.size() <= handle.id) return false;
+    const Neuron& neuron = neurons[handle.id];
+    return !neuron.deleted && neuron.generation == handle.generation;
+}
+
+bool NeuCor::isAlive(SynapseHandle handle) const {
+    if (handle.generation == 0 || neurons.size() <= handle.fromID) return false;
+    const Synapse* synapse = getSynapse(handle.fromID, handle.toID);
+    return synapse && synapse->generation == handle.generation;
+}
+
+simulator::simulator(NeuCor* p, simulatorType type)
+:type(type), generation(0) {
     parentNet = p;
-    lastRan = parentNet->getTime();
+    lastRan = parentNet->getTicks();
 }
 
 deletedSimulator::deletedSimulator(NeuCor* p): simulator(p) {};
 
 InputFirer::InputFirer(NeuCor* p, coord3 position, float radius)
-:simulator(p), radius(radius), lastFire(0.0) {
+:simulator(p, SIMULATOR_INPUT), radius(radius), lastFire(0), rate(0.0f) {
     if (position.x == position.x) a = position; // If x isn't NAN
-    else a = {(randomUnit()-0.5f)*5.f,(randomUnit()-0.5f)*5.f,(randomUnit()-0.5f)*5.f};
+    else a = {(p->randomUnit()-0.5f)*5.f,(p->randomUnit()-0.5f)*5.f,(p->randomUnit()-0.5f)*5.f};
 
     enabled = true;
 
@@ -331,23 +1263,67 @@ void InputFirer::run(){
 }
 
 void InputFirer::schedule(float deltaT, float frequency){
-    if (frequency == 0 || !enabled) return;
+    if (!enabled) return;
+
+    tick_t const currentT = parentNet->getTicks();
+    tick_t const endT = currentT + parentNet->toTicks(deltaT);
 
-    if (lastFire != lastFire) lastFire = 0;
-    float currentT = parentNet->getTime();
+    // The time span is split wherever the scheduled rate changes
+    for (tick_t from = currentT; from < endT;){
+        tick_t to = endT;
+        rate = scheduledRate(from, to, frequency);
+        scheduleRate(from, to, rate);
+        from = to;
+    }
+}
 
-    for (float fireTime = lastFire + 1000.0/frequency; fireTime < currentT + deltaT; fireTime += 1000.0/frequency){
-        if (currentT < fireTime){
-            parentNet->queueSimulation(this, fireTime-currentT);
-            lastFire = fireTime;
+float InputFirer::scheduledRate(tick_t t, tick_t& changeTime, float arrayFrequency, unsigned depth){
+    auto next = std::upper_bound(segments.begin(), segments.end(), t,
+        [](tick_t time, const InputSegment& segment){return time < segment.start;});
+    if (next != segments.end()) changeTime = std::min(changeTime, next->start);
+    if (next == segments.begin()) return arrayFrequency;
+
+    InputSegment& segment = *(next-1);
+    switch (segment.mode){
+        case InputSegment::SEGMENT_CONSTANT:
+            return segment.rate;
+        case InputSegment::SEGMENT_RANDOM_WALK: {
+            if (segment.walk.empty()) segment.walk.emplace_back(segment.start, segment.rate);
+            while (segment.walk.back().first + segment.interval <= t){
+                float const stepped = segment.walk.back().second + (parentNet->randomUnit()*2.0f - 1.0f)*segment.step;
+                segment.walk.emplace_back(segment.walk.back().first + segment.interval, fmin(segment.maxRate, fmax(segment.minRate, stepped)));
+            }
+            // Times before the current time are never asked for again, but linked inputs may ask for any time in the current run() call
+            while (1 < segment.walk.size() && segment.walk[1].first <= parentNet->getTicks()) segment.walk.pop_front();
+
+            auto step = segment.walk.end() - 1;
+            while (t < step->first) step--;
+            changeTime = std::min(changeTime, step->first + segment.interval);
+            return step->second;
         }
+        case InputSegment::SEGMENT_LINKED:
+            if (parentNet->inputHandler.size() <= segment.source || parentNet->inputHandler.size() < depth) return 0.0f;
+            return parentNet->inputHandler[segment.source].scheduledRate(t, changeTime, parentNet->inputArrayRate(segment.source), depth+1);
+    }
+    return 0.0f;
+}
+
+void InputFirer::scheduleRate(tick_t from, tick_t to, float frequency){
+    if (frequency <= 0.0f) return;
+    tick_t const period = std::max<tick_t>(1, parentNet->toTicks(1000.0f/frequency));
+
+    tick_t fireTime = lastFire + period;
+    if (fireTime < from) fireTime += (from - fireTime + period - 1)/period*period; // Firings which would have been before from are skipped
+    for (; fireTime < to; fireTime += period){
+        parentNet->queueSimulationAt(this, fireTime);
+        lastFire = fireTime;
     }
 }
 
 VoltageDetector::VoltageDetector(NeuCor* p, coord3 position, float radius)
 :parentNet(p), radius(radius) {
     if (position.x == position.x) a = position; // If x isn't NAN
-    else a = {(randomUnit()-0.5f)*3.f,(randomUnit()-0.5f)*3.f,(randomUnit()-0.5f)*3.f};
+    else a = {(p->randomUnit()-0.5f)*3.f,(p->randomUnit()-0.5f)*3.f,(p->randomUnit()-0.5f)*3.f};
 
     for (auto &neu: parentNet->neurons){
         if (neu.position().getDist(a) < radius){
@@ -365,33 +1341,46 @@ float VoltageDetector::getVoltage() {
     return avgV/near.size();
 }
 
-Neuron::Neuron(NeuCor* p, coord3 position)
-:simulator(p), ownID(p->getFreeID()), traceDecayRate(p->postsynapticTraceDecay) {
+Neuron::Neuron(NeuCor* p, coord3 position, unsigned type)
+:simulator(p, SIMULATOR_NEURON), outSynapses(SynapseVector::allocator_type(&p->arena)), inSynapses(InSynapseMap::allocator_type(&p->arena)),
+ownID(p->getFreeID()), type(type) {
     auto registration = p->registerNeuron(position, 0.0, 1.0);
     pos = std::get<0>(registration);
     PA = std::get<1>(registration);
+    changedEpoch = 0;
 
     outSynapses.reserve(5);
-
-    baselevel = -70.0;
-    threshold = -55.0;
-    recharge = 0.5;
-
-    //reuptake = (float) rand()/RAND_MAX;
-    reuptake = 0.5;
-    buffer = 5.0;
-
-    AP_h = 100.0, AP_depolW = 0.3, AP_polW = 0.6, AP_deltaPol = 1.16, AP_depolFac = 0.2, AP_deltaStart = 1.0;
-    AP_cutoff = 2.0;
-
-    activityStartTime = parentNet->getTime();
+    initialize();
+}
+Neuron::Neuron(NeuCor* p, std::size_t ID, Arena* arena)
+:simulator(p, SIMULATOR_NEURON), outSynapses(SynapseVector::allocator_type(arena)), inSynapses(InSynapseMap::allocator_type(arena)),
+ownID(ID), type(0) {
+    pos = ID;
+    PA = 2*ID;
+    changedEpoch = p->epoch; // Reported by NeuCor::markAllChanged() instead of the log
+    deleted = true; // Until initialize()
+    compactionQueued = false;
+}
+void Neuron::initialize(){
+    deleted = false;
+    compactionQueued = false;
+
+    const NeuronType& t = parameters();
+    activityStartTime = parentNet->getTicks();
     firings = 0;
     setActivity(0);
 
-    vesicles = buffer * 0.75;
-    lastFire = NAN;
+    vesicles = t.buffer * 0.75;
+    recovery = 0.0;
+    lastFire = NeuCor::neverTick;
+    previousFire = NeuCor::neverTick;
+    scheduledFireTime = NeuCor::neverTick;
+    lastActivityWindow = -1;
+    recentDeliveries = 0;
+    clockDriven = false;
+    lastCharged = lastRan;
 
-    setPotential(baselevel);
+    parentNet->neuronInitializer(*this, t);
 }
 Neuron::~Neuron(){
 
@@ -407,10 +1396,24 @@ Neuron& Neuron::operator=(const Neuron& other){
     outSynapses = other.outSynapses;
     inSynapses = other.inSynapses;
 
+    type = other.type;
+    vesicles = other.vesicles;
+    recovery = other.recovery;
+    lastRan = other.lastRan;
     lastFire = other.lastFire;
+    previousFire = other.previousFire;
+    lastActivityWindow = other.lastActivityWindow;
+    changedEpoch = other.changedEpoch;
+    deleted = false;
+    compactionQueued = false;
+    generation++; // A reused slot is a new neuron: handles taken before, even of the deleted neuron, stay dead
 
     activityStartTime = other.activityStartTime;
     firings = other.firings;
+    scheduledFireTime = other.scheduledFireTime;
+    recentDeliveries = other.recentDeliveries;
+    clockDriven = false; // Until the next migration, which rebuilds NeuCor::clockDriven
+    lastCharged = other.lastCharged;
     setActivity(0);
 
     return *this;
@@ -430,7 +1433,7 @@ void Neuron::makeConnections(){
                 }
             }
             for (size_t j = 0; j<outSynapses.size(); j++){
-                if (outSynapses.at(j).tN == i){
+                if (outSynapses.at(j).tN == i && !outSynapses.at(j).deleted){
                     allowed = false;
                     break;
                 }
@@ -452,39 +1455,76 @@ void Neuron::removeInSyn(std::size_t synFrom){
 }
 
 coord3 Neuron::position() const { return parentNet->positions.at(pos); }
-void Neuron::setPosition(coord3 newPos){parentNet->positions.at(pos) = newPos;}
+void Neuron::setPosition(coord3 newPos){
+    parentNet->positions.at(pos) = newPos;
+    if (changedEpoch != parentNet->epoch) parentNet->markChanged(*this);
+}
 float Neuron::potential() const { return parentNet->potAct.at(PA); }
-void Neuron::setPotential(float p){parentNet->potAct.at(PA) = p;}
+void Neuron::setPotential(float p){
+    parentNet->potAct.at(PA) = p;
+    if (changedEpoch != parentNet->epoch) parentNet->markChanged(*this);
+}
 float Neuron::activity() const { return parentNet->potAct.at(PA + 1); }
-void Neuron::setActivity(float a){parentNet->potAct.at(PA+1) = a;}
-void Neuron::resetActivity(){firings = 0; activityStartTime = parentNet->getTime(); setActivity(0.0);}
+void Neuron::setActivity(float a){
+    parentNet->potAct.at(PA+1) = a;
+    if (changedEpoch != parentNet->epoch) parentNet->markChanged(*this);
+}
+void Neuron::resetActivity(){firings = 0; activityStartTime = parentNet->getTicks(); setActivity(0.0);}
 std::size_t Neuron::getID() const { return ownID;}
+unsigned Neuron::getType() const { return type;}
+bool Neuron::isDeleted() const { return deleted;}
 
 Synapse::Synapse(NeuCor* p, std::size_t parent, std::size_t target)
-:simulator(p), traceDecayRate(p->presynapticTraceDecay) {
+:simulator(p, SIMULATOR_SYNAPSE) {
     pN = parent;
     tN = target;
     parentNet->getNeuron(target)->inSynapses.emplace(parent, target);
 
-    lastSpikeArrival = -INFINITY;
+    lastSpikeArrival = NeuCor::neverTick;
+    lastSpikeStart = 0;
 
-    weight = randomUnit()*0.8f + 0.2f;
+    weight = parentNet->randomUnit()*0.8f + 0.2f;
 
-    if (randomUnit() < 0.2f) weight = -weight;
+    if (parentNet->randomUnit() < 0.2f) weight = -weight;
 
     inhibitory = weight < 0.0;
+    parentNet->weightSum += weight;
+    parentNet->synapseCount++;
 
     coord3 n1 = parentNet->getNeuron(target)->position();
     coord3 n2 = parentNet->getNeuron(parent)->position();
     length = n2.getDist(n1);
 
-    averageSynapseTrace = 0.0, averageNeuronTrace = 0.0;
-    synapticPlasticityCalls = 0;
+    AP_polW = 0, AP_depolFac = 0, AP_deltaStart = 0, AP_fireTime = 0;
+    AP_speed = 2.0;
+
+    changedEpoch = 0;
+    packedIndex = 0;
+    deleted = false;
+    generation = ++parentNet->synapseGenerations;
+    parentNet->markChanged(*this);
+    parentNet->topologyVersion++;
+}
+Synapse::Synapse(NeuCor* p, std::size_t parent, std::size_t target, float weight, float length, std::uint32_t generation)
+:simulator(p, SIMULATOR_SYNAPSE) {
+    pN = parent;
+    tN = target;
+    lastSpikeArrival = NeuCor::neverTick;
+    lastSpikeStart = 0;
+
+    this->weight = weight;
+    inhibitory = weight < 0.0;
+    this->length = length;
 
     AP_polW = 0, AP_depolFac = 0, AP_deltaStart = 0, AP_fireTime = 0;
     AP_speed = 2.0;
+
+    changedEpoch = parentNet->epoch;
+    packedIndex = 0;
+    deleted = false;
+    this->generation = generation;
 }
-Synapse::Synapse(const Synapse &other):simulator(other.parentNet), traceDecayRate(other.traceDecayRate){
+Synapse::Synapse(const Synapse &other):simulator(other.parentNet, SIMULATOR_SYNAPSE){
     // Simulator member update
     lastRan = other.lastRan;
 
@@ -492,15 +1532,19 @@ Synapse::Synapse(const Synapse &other):simulator(other.parentNet), traceDecayRat
     pN = other.pN;
     tN = other.tN;
     lastSpikeArrival = other.lastSpikeArrival;
+    lastSpikeStart = other.lastSpikeStart;
 
     length = other.length;
     weight = other.weight;
+    inhibitory = other.inhibitory;
 
-    averageSynapseTrace = other.averageSynapseTrace, averageNeuronTrace = other.averageNeuronTrace;
-    synapticPlasticityCalls = other.synapticPlasticityCalls;
-
-    AP_polW = 0, AP_depolFac = 0, AP_deltaStart = 0, AP_fireTime = 0;
+    // Spikes in flight and their delivered tails move along, since compaction shifts synapses within their vector
+    AP_polW = other.AP_polW, AP_depolFac = other.AP_depolFac, AP_deltaStart = other.AP_deltaStart, AP_fireTime = other.AP_fireTime;
     AP_speed = other.AP_speed;
+    changedEpoch = other.changedEpoch;
+    packedIndex = other.packedIndex;
+    generation = other.generation;
+    deleted = other.deleted;
 }
 Synapse& Synapse::operator= (const Synapse &other){
     // Simulator member update
@@ -510,15 +1554,19 @@ Synapse& Synapse::operator= (const Synapse &other){
     pN = other.pN;
     tN = other.tN;
     lastSpikeArrival = other.lastSpikeArrival;
+    lastSpikeStart = other.lastSpikeStart;
 
     length = other.length;
     weight = other.weight;
+    inhibitory = other.inhibitory;
 
-    averageSynapseTrace = other.averageSynapseTrace, averageNeuronTrace = other.averageNeuronTrace;
-    synapticPlasticityCalls = other.synapticPlasticityCalls;
-
-    AP_polW = 0, AP_depolFac = 0, AP_deltaStart = 0, AP_fireTime = 0;
+    // Spikes in flight and their delivered tails move along, since compaction shifts synapses within their vector
+    AP_polW = other.AP_polW, AP_depolFac = other.AP_depolFac, AP_deltaStart = other.AP_deltaStart, AP_fireTime = other.AP_fireTime;
     AP_speed = other.AP_speed;
+    changedEpoch = other.changedEpoch;
+    packedIndex = other.packedIndex;
+    generation = other.generation;
+    deleted = other.deleted;
 
     return *this;
 }
@@ -526,6 +1574,7 @@ Synapse::~Synapse(){
 
 }
 void Synapse::flipDirection(){
+    parentNet->topologyVersion++;
     Neuron* neuP = parentNet->getNeuron(pN);
     Neuron* neuT = parentNet->getNeuron(tN);
 
@@ -544,221 +1593,450 @@ void Synapse::flipDirection(){
 }
 
 
-#define AP_RENDER_BEHAVIOUR                                 \
-    val = fmin(fmax(val,0.0),0.7);                           \
-    if (val < 0.5) val = 8.0*1000.0*powf(val/5.0,3.0);        \
-    else val = 8.0*powf(3.5-5*val,2.0);
+// Rendered pulse strength along a synapse, by the fraction of the delay that has passed (clamped to [0, 0.7])
+static constexpr Waveform<70> renderPulse = sampleWaveform<70>([](double val){
+    return val < 0.5 ? 64.0*val*val*val : 8.0*(3.5-5.0*val)*(3.5-5.0*val);
+}, 0.0f, 0.7f);
+
 float Synapse::getPrePot() const {
-    if (AP_fireTime != 0.0){
-        float val = float(parentNet->getTime() - lastSpikeStart)/(length*AP_speed);
-        AP_RENDER_BEHAVIOUR;
-        return val*weight;
+    if (AP_fireTime != 0){
+        return renderPulse(parentNet->msSince(lastSpikeStart)/(length*AP_speed))*weight;
     }
     else return 0.0;
 }
 
 float Synapse::getPostPot() const {
-    if (AP_fireTime != 0.0 && parentNet->getTime() < AP_fireTime){
-        float val = float(AP_fireTime - parentNet->getTime())/(length*AP_speed);
-        AP_RENDER_BEHAVIOUR;
-        return val*weight;
+    if (AP_fireTime != 0 && parentNet->getTicks() < AP_fireTime){
+        return renderPulse(parentNet->toMs(AP_fireTime - parentNet->getTicks())/(length*AP_speed))*weight;
     }
     else return 0.0;
 }
 
-
-#undef AP_RENDER_BEHAVIOUR
-
 float Synapse::getWeight() const {
     return weight;
 }
 
+bool Synapse::isDeleted() const {
+    return deleted;
+}
+
 void Synapse::setWeight(float w) {
+    parentNet->weightSum += w - weight;
     weight = w;
     inhibitory = weight<0.0;
+    if (!parentNet->weightObservers.empty()) parentNet->recordWeight(*this);
+    if (changedEpoch != parentNet->epoch) parentNet->markChanged(*this);
 }
 
 /* Simulation related methods */
 
+template <typename Model, typename Rule>
+inline void NeuCor::dispatch(simulator* s){
+    if (s->type == simulator::SIMULATOR_NEURON) static_cast<Neuron*>(s)->update<Model>();
+    else if (s->type == simulator::SIMULATOR_SYNAPSE) static_cast<Synapse*>(s)->deliver<Model, Rule>();
+    else s->run();
+}
+
+template <typename Model, typename Rule>
+inline void NeuCor::execute(simulator* s){
+    if (flightRecorder){
+        double const weightBefore = weightSum;
+        dispatch<Model, Rule>(s);
+        recordEvent(s, float(weightSum - weightBefore));
+    }
+    else dispatch<Model, Rule>(s);
+    eventCount++;
+}
+
+// The event loop of run(), compiled for each neuron model and plasticity rule, so that neuron updates and the plasticity of
+// delivered spikes are inlined. Firing neurons apply the rule to their in-synapses through a single firingKernel call per spike.
+template <typename Model, typename Rule>
+void NeuCor::drain(tick_t targetTime){
+    tick_t const clockPeriod = std::max<tick_t>(1, toTicks(clockDrivenPeriod));
+    if (nextClockTick < currentTick) nextClockTick = currentTick;
+    while (true){
+        bool const queued = simulationQueue.size() != 0 && simulationQueue.top().stime <= targetTime;
+        if (!clockDriven.empty() && nextClockTick <= targetTime && (!queued || nextClockTick <= simulationQueue.top().stime)){
+            currentTick = nextClockTick; // Clock driven neurons are updated before the events of the same tick
+            for (std::size_t ID: clockDriven) execute<Model, Rule>(&neurons[ID]);
+            nextClockTick += clockPeriod;
+            continue;
+        }
+        if (!queued) break;
+        currentTick = simulationQueue.top().stime;
+        simulator* const s = simulationQueue.top().addr;
+        if (simulationQueue.top().generation != s->generation){ // Queued before the simulated object was deleted or replaced
+            simulationQueue.pop();
+            continue;
+        }
+        execute<Model, Rule>(s);
+        simulationQueue.pop();
+    }
+}
+
+void NeuCor::migrateNeurons(){
+    float const interval = toMs(currentTick - lastMigration)/1000.0f; // s
+    lastMigration = currentTick;
+    clockDriven.clear();
+    for (auto &neu: neurons){
+        float const rate = neu.recentDeliveries/interval;
+        neu.recentDeliveries = 0;
+        if (neu.clockDriven && (neu.deleted || rate < clockDrivenRate*0.5f)) releaseClockDriven(neu);
+        else if (!neu.deleted && clockDrivenRate <= rate && !neu.clockDriven){
+            neu.clockDriven = true;
+            neu.lastCharged = neu.lastRan;
+        }
+        if (neu.clockDriven) clockDriven.push_back(neu.getID());
+    }
+}
+
+void NeuCor::releaseClockDriven(Neuron& neuron){
+    neuron.clockDriven = false;
+    // Spikes delivered within the last AP_cutoff ms charge the neuron until then, as after Neuron::transfer()
+    if (!neuron.deleted) queueSimulation(&neuron, neuron.parameters().AP_cutoff);
+}
+
+std::size_t NeuCor::getClockDrivenCount() const {
+    return clockDriven.size();
+}
+
 void NeuCor::run(){
     assert(0 <= runSpeed);
     if (runSpeed <= 0.0f) {
         return;
     }
 
-    for (auto it = synapseFlippingQueue.begin(); it != synapseFlippingQueue.end(); it++)
-        if (Synapse* synapse = getSynapse(*it)) {
-            synapse->flipDirection();
-        }
-    synapseFlippingQueue.clear();
+    if (perfProfile) perfProfile->begin(PerfProfile::PHASE_PREPARE);
+    std::uint64_t const startEventCount = eventCount;
+
+    if (!synapseFlippingQueue.empty() || !compactionQueue.empty() || !pendingSynapses.empty()) compactStructure();
+
+    if (stimulusQueue) drainStimuli();
 
     if (runAll){
         for (auto &neu: neurons) queueSimulation(&neu, 0.0);
     }
+    else if (hybrid && std::max<tick_t>(1, toTicks(migrationInterval)) <= currentTick - lastMigration) migrateNeurons();
+    if ((runAll || !hybrid) && !clockDriven.empty()){ // Hybrid scheduling was turned off
+        for (std::size_t ID: clockDriven) releaseClockDriven(neurons[ID]);
+        clockDriven.clear();
+    }
 
-    for (int i = 0; i<inputHandler.size(); i++){
-        const float inputFrequency = inputArray != nullptr && static_cast<unsigned>(i) < inputArraySize ? inputArray[i] : 0.0f;
-        inputHandler.at(i).schedule(runSpeed, inputFrequency);
+    for (unsigned i = 0; i<inputHandler.size(); i++){
+        inputHandler.at(i).schedule(runSpeed, inputArrayRate(i));
     }
 
     for (std::size_t i = 0; i < neurons.size(); ++i){ // Background firing
         const int backgroundFirePeriod = std::max(1, static_cast<int>(600.0f / runSpeed));
-        if (rand()%backgroundFirePeriod == 0) neurons.at(rand()%neurons.size()).scheduleFire(randomUnit()*runSpeed);
+        if (random()%backgroundFirePeriod == 0) neurons.at(random()%neurons.size()).scheduleFire(randomUnit()*runSpeed);
     }
 
-    float const targetTime = currentTime + runSpeed;
-    while (simulationQueue.size() != 0){
-        currentTime = simulationQueue.top().stime;
-        if (currentTime < simulationQueue.top().stime || targetTime < currentTime) break;
-        simulationQueue.top().addr->run();
-        simulationQueue.pop();
+    if (perfProfile){
+        perfProfile->end(PerfProfile::PHASE_PREPARE);
+        perfProfile->begin(PerfProfile::PHASE_DRAIN);
+    }
+
+    tick_t const targetTime = currentTick + toTicks(runSpeed);
+    (this->*drainKernel)(targetTime);
+    currentTick = targetTime;
+    publishCounters();
+    deliverObservations();
+    if (publisher) publisher->publish(*this);
+    epoch++;
+
+    if (flightRecorder && flightRecorder->dumpRequested()){
+        const std::string path = flightRecorder->signalDumpPath() + ".txt";
+        if (flightRecorder->dump(path)) std::cout<<"Flight record written to "<<path<<'\n';
+    }
+
+    if (perfProfile){ // Both phases are normalised by the events of this step
+        perfProfile->end(PerfProfile::PHASE_DRAIN, eventCount - startEventCount);
+        perfProfile->addEvents(PerfProfile::PHASE_PREPARE, eventCount - startEventCount);
     }
-    currentTime = targetTime;
 }
 
-void Neuron::run(){
-    // Determine time
-    float currentT = parentNet->getTime();
-    float deltaT = currentT - lastRan;
-    lastRan = currentT;
+NeuCor::RunProgress NeuCor::runFor(float simTarget, float wallBudget, float sliceLength){
+    assert(0 < sliceLength);
+    std::chrono::steady_clock::time_point const start = std::chrono::steady_clock::now();
+    float const staticRunSpeed = runSpeed;
+    tick_t const startTick = currentTick;
+    tick_t const targetTick = currentTick + toTicks(simTarget);
+
+    RunProgress progress = {};
+    while (currentTick < targetTick){
+        tick_t const before = currentTick;
+        runSpeed = std::min(sliceLength, toMs(targetTick - currentTick));
+        run();
+        progress.slices++;
+        progress.wallTime = std::chrono::duration<float, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (currentTick == before || wallBudget <= progress.wallTime) break;
+    }
+    runSpeed = staticRunSpeed;
 
-    // Exit function if no time has passed
-    if (deltaT == 0) return;
+    progress.simulated = toMs(currentTick - startTick);
+    progress.remaining = toMs(std::max<tick_t>(0, targetTick - currentTick));
+    return progress;
+}
 
-    // Integrates the potentials of the input synapses
-    charge_insynapses(deltaT, currentT);
-    // Exponentially decays/grows neuron potential towards base level
-    charge_passive(deltaT, currentT);
-    // Checks if neuron potential is above threshold, and if so fires neuron
-    charge_thresholdCheck(deltaT, currentT);
-    // If neuron is firing, shapes the action potential by setting the potential
-    AP(currentT);
-    // Increases vesicles amount
-    vesicles_uptake(deltaT);
+void Neuron::run(){
+    parentNet->neuronKernel(*this);
+}
 
-    // Update activity
-    setActivity(firings/(((float) currentT-activityStartTime)/10.0));
+void Neuron::fire(){
+    parentNet->firingKernel(*this);
 }
 
+template <typename Rule>
 void Neuron::fire(){
-    lastFire = parentNet->getTime();
+    if (deleted) return;
+    parentNet->countSpike(*this);
+    if (parentNet->flightRecorder) parentNet->flightRecorder->record(FlightRecorder::EVENT_SPIKE, ownID, parentNet->getTime());
+    previousFire = lastFire;
+    lastFire = parentNet->getTicks();
     firings++;
 
+    const NeuronType& t = parameters();
     for (size_t s = 0; s < outSynapses.size(); s++){
-        outSynapses.at(s).fire(AP_polW, AP_depolFac, AP_deltaStart);
+        outSynapses.at(s).fire(t.AP_polW, t.AP_depolFac, t.AP_deltaStart);
     }
 
     for (auto syn = inSynapses.begin(); syn != inSynapses.end(); syn++){
-        parentNet->getSynapse(syn->first, syn->second)->synapticPlasticity();
+        Synapse* const s = parentNet->getSynapse(syn->first, syn->second);
+        Synapse::postsynapticPlasticity<Rule>(*s);
     }
 
     //vesicles -= 5.0;
 }
 
 void Neuron::scheduleFire(float const time){
-    scheduledFireTime = parentNet->getTime()+time;
-    parentNet->queueSimulation(this, time);
+    scheduledFireTime = parentNet->getTicks() + parentNet->toTicks(time);
+    parentNet->queueSimulationAt(this, scheduledFireTime);
 }
 
 void Neuron::transfer(){
+    recentDeliveries++;
+    if (clockDriven) return; // Charged by its next clock update instead
     run();
-    parentNet->queueSimulation(this, AP_cutoff);
+    parentNet->queueSimulation(this, parameters().AP_cutoff);
+}
+
+template <typename Model>
+void Neuron::transfer(){
+    recentDeliveries++;
+    if (clockDriven) return;
+    update<Model>();
+    parentNet->queueSimulation(this, parameters().AP_cutoff);
 }
 void Neuron::givePotential(float pot){
     setPotential(potential()+pot);
 }
 
 float Neuron::getTrace() const {
-    float t = powf(traceDecayRate, parentNet->getTime()-lastFire);
-    if (t == t) return t;
-    else return 0;
+    if (lastFire == NeuCor::neverTick) return 0;
+    return parentNet->typeTables[type].traceDecay(parameters().traceDecayRate, parentNet->msPerTick, parentNet->currentTick - lastFire);
 }
 
-void Neuron::charge_passive(float deltaT, float currentT){
-    float newPot = ((float) potential()-baselevel) * powf(recharge, deltaT) + baselevel;
-    setPotential(newPot);
+void TraceDecay::refresh(float rate, double msPerTick){
+    cachedRate = rate, cachedMsPerTick = msPerTick;
+    log2PerTick = log2(double(rate))*msPerTick;
+    // Delays in ticks until rate^ms < 2^-24
+    double const span = 0.0 < rate && rate < 1.0 ? ceil(-24.0/log2PerTick) : double(maxTableSize);
+    table.resize(static_cast<std::size_t>(fmin(span, double(maxTableSize))));
+    for (std::size_t delay = 0; delay < table.size(); delay++) table[delay] = static_cast<float>(pow(double(rate), double(delay)*msPerTick));
 }
 
-void Neuron::charge_thresholdCheck(float deltaT, float currentT){
-    if ( (threshold < potential() || scheduledFireTime == parentNet->getTime())
-        && (lastFire != lastFire || AP_cutoff < (float) currentT-lastFire) && 0.0 < vesicles)
-            fire();
+const NeuronType& Neuron::parameters() const {
+    return parentNet->neuronTypes[type];
 }
 
-void Neuron::charge_insynapses(float deltaT, float currentT){
+void Neuron::charge_insynapses(const NeuronType& t, float deltaT, tick_t currentT){
     float newPot = potential();
     for (auto syn: inSynapses){
         auto s = parentNet->getSynapse(syn.first, syn.second);
-        float timeOffset = currentT - s->AP_fireTime;
-        if (timeOffset <= 0.0 || s->AP_fireTime == 0) continue;
+        if (currentT <= s->AP_fireTime || s->AP_fireTime == 0) continue;
+        float timeOffset = parentNet->toMs(currentT - s->AP_fireTime);
 
         newPot += deltaT*s->AP_depolFac*0.9943*exp(0.3702*deltaT);
 
-        if (AP_cutoff < timeOffset) s->AP_fireTime = 0;
+        if (t.AP_cutoff < timeOffset) s->AP_fireTime = 0;
+    }
+    setPotential(newPot);
+}
+
+void Neuron::charge_insynapses_clocked(const NeuronType& t, tick_t deltaT, tick_t currentT, bool leaky){
+    tick_t const stepStart = currentT - deltaT;
+    tick_t const cutoff = parentNet->toTicks(t.AP_cutoff);
+    std::vector<tick_t>& updates = parentNet->clockedUpdates;
+    clockedUpdateTimes(currentT, cutoff, updates);
+
+    float newPot = potential();
+    for (auto syn: inSynapses){
+        auto s = parentNet->getSynapse(syn.first, syn.second);
+        if (currentT <= s->AP_fireTime || s->AP_fireTime == 0) continue;
+        // The kernel of charge_insynapses() over each interval between updates, from the delivery to the first update past the window.
+        // An event driven run adds the charge of an interval before the model's leak over it, so it leaks from the interval's start
+        tick_t from = std::max(lastCharged, s->AP_fireTime);
+        for (tick_t update: updates){
+            if (update <= from) continue;
+            float const charged = parentNet->toMs(update - from);
+            float const leak = leaky ? powf(t.recharge, parentNet->toMs(stepStart - from)) : 1.0f;
+            newPot += charged*s->AP_depolFac*0.9943*exp(0.3702*charged)*leak;
+            from = update;
+            if (cutoff < update - s->AP_fireTime){
+                s->AP_fireTime = 0;
+                break;
+            }
+        }
     }
+    if (!updates.empty()) lastCharged = updates.back();
     setPotential(newPot);
 }
 
-void Neuron::vesicles_uptake(float deltaT){
-    vesicles = fmin(buffer, vesicles + reuptake * deltaT);
+void Neuron::clockedUpdateTimes(tick_t currentT, tick_t cutoff, std::vector<tick_t>& updates) const {
+    updates.clear();
+    for (auto syn: inSynapses){
+        const Synapse* s = parentNet->getSynapse(syn.first, syn.second);
+        if (s->AP_fireTime == 0) continue;
+        if (lastCharged < s->AP_fireTime && s->AP_fireTime <= currentT) updates.push_back(s->AP_fireTime);
+        if (lastCharged < s->AP_fireTime + cutoff && s->AP_fireTime + cutoff <= currentT) updates.push_back(s->AP_fireTime + cutoff);
+    }
+    std::sort(updates.begin(), updates.end());
+    updates.erase(std::unique(updates.begin(), updates.end()), updates.end());
+}
+
+void Neuron::charge_insynapses_clocked_fixed(const NeuronType& t, tick_t deltaT, tick_t currentT){
+    static constexpr std::int64_t growthLog2 = static_cast<std::int64_t>(0.3702/0.6931471805599453*(std::int64_t(1) << FixedPoint::exponentBits) + 0.5);
+    static constexpr std::int64_t scale = static_cast<std::int64_t>(0.9943*FixedPoint::one + 0.5);
+    const std::int64_t ticksPerMs = parentNet->ticksPerMs;
+    tick_t const stepStart = currentT - deltaT;
+    tick_t const cutoff = parentNet->toTicks(t.AP_cutoff);
+    std::vector<tick_t>& updates = parentNet->clockedUpdates;
+    clockedUpdateTimes(currentT, cutoff, updates);
+
+    std::int64_t newPot = FixedPoint::toFixed(potential(), FixedPoint::potentialBits);
+    for (auto syn: inSynapses){
+        auto s = parentNet->getSynapse(syn.first, syn.second);
+        if (currentT <= s->AP_fireTime || s->AP_fireTime == 0) continue;
+        // As in charge_insynapses_clocked(), with the kernel of charge_insynapses_fixed(). Both fixed point models leak
+        tick_t from = std::max(lastCharged, s->AP_fireTime);
+        for (tick_t update: updates){
+            if (update <= from) continue;
+            const tick_t charged = update - from;
+            const std::int64_t chargedMs = (charged/ticksPerMs << FixedPoint::potentialBits) + (charged%ticksPerMs << FixedPoint::potentialBits)/ticksPerMs;
+            std::int64_t charge = FixedPoint::mul(FixedPoint::mul(chargedMs, scale, FixedPoint::factorBits), FixedPoint::power(growthLog2, charged, ticksPerMs), FixedPoint::factorBits);
+            charge = FixedPoint::mul(charge, parentNet->typeTables[type].fixedRecharge(t.recharge, stepStart - from, ticksPerMs), FixedPoint::factorBits);
+            newPot += FixedPoint::mul(charge, FixedPoint::toFixed(s->AP_depolFac, FixedPoint::potentialBits), FixedPoint::potentialBits);
+            from = update;
+            if (cutoff < update - s->AP_fireTime){
+                s->AP_fireTime = 0;
+                break;
+            }
+        }
+    }
+    if (!updates.empty()) lastCharged = updates.back();
+    setPotential(FixedPoint::toFloat(newPot, FixedPoint::potentialBits));
 }
 
-void Neuron::AP(float currentT){
-    if (lastFire != lastFire || AP_cutoff < (float) currentT-lastFire) return;
+void Neuron::charge_insynapses_fixed(const NeuronType& t, tick_t deltaT, tick_t currentT){
+    // e^(0.3702 ms) as log2 per ms, and 0.9943, as in charge_insynapses()
+    static constexpr std::int64_t growthLog2 = static_cast<std::int64_t>(0.3702/0.6931471805599453*(std::int64_t(1) << FixedPoint::exponentBits) + 0.5);
+    static constexpr std::int64_t scale = static_cast<std::int64_t>(0.9943*FixedPoint::one + 0.5);
+    const std::int64_t ticksPerMs = parentNet->ticksPerMs;
+    const tick_t cutoff = parentNet->toTicks(t.AP_cutoff);
+
+    std::int64_t charge = -1; // Per unit of AP_depolFac, computed for the first charging synapse
+    std::int64_t newPot = FixedPoint::toFixed(potential(), FixedPoint::potentialBits);
+    for (auto syn: inSynapses){
+        auto s = parentNet->getSynapse(syn.first, syn.second);
+        if (currentT <= s->AP_fireTime || s->AP_fireTime == 0) continue;
+
+        if (charge < 0){
+            const std::int64_t deltaMs = (deltaT/ticksPerMs << FixedPoint::potentialBits) + (deltaT%ticksPerMs << FixedPoint::potentialBits)/ticksPerMs;
+            charge = FixedPoint::mul(FixedPoint::mul(deltaMs, scale, FixedPoint::factorBits), FixedPoint::power(growthLog2, deltaT, ticksPerMs), FixedPoint::factorBits);
+        }
+        newPot += FixedPoint::mul(charge, FixedPoint::toFixed(s->AP_depolFac, FixedPoint::potentialBits), FixedPoint::potentialBits);
 
-    float currentAP = AP_h
-        * (exp(-powf(((float) currentT-lastFire) - AP_deltaStart,               2.0)/(2.0*AP_depolW*AP_depolW))
-        -  exp(-powf(((float) currentT-lastFire) - AP_deltaStart - AP_deltaPol, 2.0)/(2.0*AP_polW*AP_polW)) * AP_depolFac ) + baselevel
-        + (threshold - baselevel)*fmax(1.0+lastFire-currentT, 0.0);
-    setPotential(currentAP);
+        if (cutoff < currentT - s->AP_fireTime) s->AP_fireTime = 0;
+    }
+    setPotential(FixedPoint::toFloat(newPot, FixedPoint::potentialBits));
 }
 
+void Neuron::vesicles_uptake(const NeuronType& t, float deltaT){
+    vesicles = fmin(t.buffer, vesicles + t.reuptake * deltaT);
+}
 
+void Neuron::vesicles_uptake_fixed(const NeuronType& t, tick_t deltaT){
+    const std::int64_t buffer = FixedPoint::toFixed(t.buffer, FixedPoint::potentialBits);
+    const std::int64_t uptake = FixedPoint::toFixed(t.reuptake, FixedPoint::potentialBits)*deltaT/parentNet->ticksPerMs;
+    vesicles = FixedPoint::toFloat(std::min(buffer, FixedPoint::toFixed(vesicles, FixedPoint::potentialBits) + uptake), FixedPoint::potentialBits);
+}
 
 void Synapse::run(){
-    if (AP_fireTime < parentNet->getTime()) return;
+    if (deleted){
+        AP_fireTime = 0;
+        return;
+    }
+    if (AP_fireTime < parentNet->getTicks()) return;
 
     parentNet->getNeuron(tN)->transfer();
 
-    lastSpikeArrival = parentNet->getTime();
+    lastSpikeArrival = parentNet->getTicks();
+
+    parentNet->presynapticKernel(*this);
+}
+
+template <typename Model, typename Rule>
+void Synapse::deliver(){
+    if (deleted){
+        AP_fireTime = 0;
+        return;
+    }
+    if (AP_fireTime < parentNet->getTicks()) return;
 
-    synapticPlasticity();
+    parentNet->getNeuron(tN)->transfer<Model>();
+    lastSpikeArrival = parentNet->getTicks();
+    presynapticPlasticity<Rule>(*this);
 }
+
 void Synapse::fire(float polW, float depolFac, float deltaStart){
-    if (AP_fireTime != 0) return;
+    if (AP_fireTime != 0 || deleted) return;
     AP_polW = polW, AP_depolFac = depolFac, AP_deltaStart = deltaStart;
     AP_depolFac *= 52.0;
     AP_depolFac *= weight;
 
-    AP_fireTime = length*AP_speed;
-    parentNet->queueSimulation(this, AP_fireTime);
-    AP_fireTime += parentNet->getTime();
+    AP_fireTime = parentNet->getTicks() + parentNet->toTicks(length*AP_speed);
+    parentNet->queueSimulationAt(this, AP_fireTime);
 
-    lastSpikeStart = parentNet->getTime();
+    lastSpikeStart = parentNet->getTicks();
 }
 
-void Synapse::synapticPlasticity(){
-    float traceS = powf(traceDecayRate, parentNet->getTime()-lastSpikeArrival); // Synapse trace (presynaptic)
-    float traceT = parentNet->getNeuron(tN)->getTrace(); // Target trace (postsynaptic)
+void Synapse::applyWeightChange(float weightChange){
+    float const oldWeight = weight;
+    weight += weightChange*parentNet->learningRate;
 
-    if (traceT == 1) traceT = 0;
-    if (traceS == 1) traceS = 0;
+    if (!inhibitory) weight = fmax(fmin(weight, 1.0), 0.0);
+    else weight = fmax(fmin(weight, 0.0), -1.0);
+    weightChanged(oldWeight);
+}
 
-    synapticPlasticityCalls++;
-    averageSynapseTrace += traceS;
-    averageNeuronTrace += traceT;
+void Synapse::applyFixedWeightChange(std::int64_t weightChange){
+    float const oldWeight = weight;
+    const int shift = FixedPoint::factorBits - FixedPoint::weightBits;
+    std::int64_t w = FixedPoint::toFixed(weight, FixedPoint::factorBits);
+    w += FixedPoint::mul(weightChange, FixedPoint::toFixed(parentNet->learningRate, FixedPoint::factorBits), FixedPoint::factorBits);
 
+    if (!inhibitory) w = std::max<std::int64_t>(std::min(w, FixedPoint::one), 0);
+    else w = std::max<std::int64_t>(std::min<std::int64_t>(w, 0), -FixedPoint::one);
+    weight = FixedPoint::toFloat(w/(std::int64_t(1) << shift), FixedPoint::weightBits);
+    weightChanged(oldWeight);
+}
 
-    if (weight == 0 && !inhibitory && rand()%120 == 0 && false){ // This gives the synapse a 1/120 chance of getting a second chance in life
-        weight += 1.0; // Weight being boosted (this allows for signal expansion and reservation throughout the brain)
-        synapticPlasticityCalls = 0; averageSynapseTrace = 0; averageNeuronTrace = 0; // Resets average-bias
+void Synapse::weightChanged(float oldWeight){
+    parentNet->weightSum += weight - oldWeight;
+    if (weight != oldWeight){
+        if (!parentNet->weightObservers.empty()) parentNet->recordWeight(*this);
+        if (changedEpoch != parentNet->epoch) parentNet->markChanged(*this);
     }
 
-    float weightChange = parentNet->presynapticFactor*traceS - parentNet->postsynapticFactor*traceT;
-    weight += weightChange*parentNet->learningRate;
-
-    if (!inhibitory) weight = fmax(fmin(weight, 1.0), 0.0);
-    else weight = fmax(fmin(weight, 0.0), -1.0);
-
     //if (weight < 0) parentNet->queFlip(std::pair<std::size_t, std::size_t>(pN, tN)); // Que flipping of synapse if weight is 0
 }
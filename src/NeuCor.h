@@ -8,6 +8,14 @@
 #include <array>
 #include <math.h>
 #include <tuple>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <functional>
+
+#include "NeuCor_Arena.h"
+#include "NeuCor_Waveforms.h"
+#include "NeuCor_Fixed.h"
 
 // Simple 3D coordinate structure with distance to other coordinate function.
 struct coord3 {
@@ -23,6 +31,53 @@ struct coord3 {
     }
 };
 
+// Simulated time in integer ticks (see NeuCor::setTimeResolution()).
+// Integer time doesn't lose sub-millisecond precision as the simulation grows long, and makes equal times compare exactly.
+typedef std::int64_t tick_t;
+
+// Read-only strided view of one of a network's state arrays (see NeuCor::getPositionView()).
+// Element i is stride bytes after element i-1, so interleaved arrays can be viewed without copying them apart.
+template <typename T>
+struct ArrayView {
+    const T* data;
+    std::size_t count;
+    std::size_t stride;                  // Bytes between consecutive elements
+    const T& operator[](std::size_t i) const {return *reinterpret_cast<const T*>(reinterpret_cast<const char*>(data) + i*stride);}
+};
+
+// Parameters shared by all neurons of one type (see NeuCor::addNeuronType()). The defaults are the original neuron.
+struct NeuronType {
+    float baselevel = -70.0f, threshold = -55.0f, recharge = 0.5f;  // Base level standard voltage of neuron, voltage threshold needed to fire, exponential growth rate to base level
+    float reuptake = 0.5f, buffer = 5.0f;                           // Linear vesicle uptake, amount buffered
+    float AP_h = 100.0f, AP_depolW = 0.3f, AP_polW = 0.6f, AP_deltaPol = 1.16f, AP_depolFac = 0.2f, AP_deltaStart = 1.0f; // Defines form of action potential spike
+    float AP_cutoff = 2.0f;                                         // How long after last spike until next is allowed
+    float traceDecayRate = 0.65f;                                   // Rate at which the trace variable decays after spike
+    float resetPotential = -70.0f;                                  // LIF model: potential after a spike
+    float izhA = 0.02f, izhB = 0.2f, izhC = -65.0f, izhD = 8.0f;    // Izhikevich model: recovery rate, recovery sensitivity, reset potential, recovery reset. Regular spiking by default
+};
+
+// Exponential decay of a spike trace. rate^ms is looked up in a table of decay factors per delay in ticks, up to the delay
+// after which the trace is below float resolution, or maxTableSize ticks if that comes first. Longer delays are evaluated as
+// exp2 of a precomputed log2 factor per tick. Both are refreshed when the rate or the time resolution changes, so rates can stay plain parameters.
+class TraceDecay {
+    public:
+        static constexpr std::size_t maxTableSize = 1 << 16;        // 256 KB
+        float operator()(float rate, double msPerTick, tick_t ticks){    // rate^(ticks*msPerTick), ticks >= 0
+            if (rate != cachedRate || msPerTick != cachedMsPerTick) refresh(rate, msPerTick);
+            if (ticks < static_cast<tick_t>(table.size())) return table[ticks];
+            return exp2f(static_cast<float>(log2PerTick*double(ticks)));
+        }
+    private:
+        void refresh(float rate, double msPerTick);
+        float cachedRate = NAN;
+        double cachedMsPerTick = 0.0;
+        double log2PerTick = 0.0;
+        std::vector<float> table;
+};
+
+typedef Waveform<256> APWaveform;      // Action potential shape of a neuron type, from spike to AP_cutoff (see StandardModel::waveform())
+typedef FixedWaveform<256> FixedAPWaveform;
+
 // Prototypes.
 struct simulation;
 class simulator;
@@ -30,6 +85,11 @@ struct InputFirer;
 struct VoltageDetector;
 class Neuron;
 class Synapse;
+class PerfProfile;
+class FlightRecorder;
+class StimulusQueue;
+class GenerationPublisher;
+struct StimulusInjector;
 
 // The main network class.
 // This owns all the simulated objects, and is used to run them.
@@ -53,6 +113,17 @@ class NeuCor {
             bool inhibitory;
         };
 
+        // Handles stay comparable after the objects they refer to are deleted, and after neuron IDs are reused:
+        // isAlive() is false once the neuron or synapse it was taken from has been deleted.
+        struct NeuronHandle {
+            std::uint32_t id;
+            std::uint32_t generation;
+        };
+        struct SynapseHandle {
+            std::uint32_t fromID, toID;
+            std::uint32_t generation;        // 0 if no synapse existed
+        };
+
         struct InputSnapshot {
             std::size_t id;
             coord3 position;
@@ -62,33 +133,200 @@ class NeuCor {
         };
 
         NeuCor(int n_neurons);               // Number of initial neurons (n_neurons)
+        NeuCor(int n_neurons, std::uint64_t seed); // Deterministic network, generated and run from the given seed (see isDeterministic())
+        // Bulk construction of large (million neuron) deterministic networks. Positions, neighbour search and synapse weights are computed on
+        // the given number of threads (0 uses all hardware threads), and the synapse containers are filled in one pass. The network only
+        // depends on the seed, not on the number of threads, but differs from the one NeuCor(n_neurons, seed) generates.
+        NeuCor(int n_neurons, std::uint64_t seed, unsigned threads);
         ~NeuCor();
 
+        // In deterministic mode, events at the same time are totally ordered by (time, simulator type, target ID, queueing sequence),
+        // and all randomness comes from the network's own seeded generator instead of the global rand().
+        // Identical seeds then give bit-identical rasters, independent of the standard library's priority_queue and rand().
+        bool isDeterministic() const;
+        std::uint32_t random();              // Uniform random integer. From the network generator in deterministic mode, otherwise rand()
+        float randomUnit();                  // Uniform random float in [0, 1]
+
         void run();                          // Runs the whole simulation
+
+        struct RunProgress {
+            float simulated;                 // Simulated ms actually advanced
+            float remaining;                 // Simulated ms left of the target
+            float wallTime;                  // Wall clock ms spent
+            unsigned slices;                 // Number of run() calls
+        };
+        // Advances the simulation by simTarget ms in run() calls of at most sliceLength ms, but returns early once wallBudget (wall clock ms) is used up.
+        // At least one slice is always run. runSpeed is restored afterwards.
+        RunProgress runFor(float simTarget, float wallBudget, float sliceLength);
         float runSpeed;                      // What timestep (in ms) is used when run() is called
         bool runAll;                         // If all the neurons should be updated, instead of only the necessary ones. Useful when rendering
-        float getTime() const;               // The amount of time (in ms) that has been simulated
+        // Hybrid scheduling, used when runAll is off. Event driven, a neuron is updated twice per delivered spike (see transfer()). Neurons that
+        // are delivered clockDrivenRate spikes per second or more are clock driven instead: updated every clockDrivenPeriod ms, directly from a
+        // dense ID ordered set, while delivered spikes no longer update or queue them. Rates are measured every migrationInterval ms (at least
+        // one tick), and clock driven neurons become event driven again below half of clockDrivenRate.
+        bool hybrid;
+        float clockDrivenRate, clockDrivenPeriod, migrationInterval;
+        std::size_t getClockDrivenCount() const;
+        double getTime() const;              // The amount of time (in ms) that has been simulated
+
+        // Internally all times are integer ticks, by default 1000 per ms (1 us). Floating point ms are only used at the API.
+        // The resolution can only be changed before anything has been simulated or queued; returns false otherwise.
+        bool setTimeResolution(std::int64_t ticksPerMs);
+        std::int64_t getTimeResolution() const;
+        tick_t getTicks() const;             // The amount of time (in ticks) that has been simulated
+        static constexpr tick_t neverTick = INT64_MIN; // Time of events that haven't happened, e.g. Neuron::lastFire before the first spike
+        tick_t toTicks(float ms) const {return static_cast<tick_t>(llround(double(ms)*ticksPerMs));} // Rounds a duration (ms) to ticks
+        float toMs(tick_t ticks) const {return static_cast<float>(double(ticks)*msPerTick);}          // Converts a duration in ticks to ms
+        float msSince(tick_t t) const {return t == neverTick ? INFINITY : toMs(currentTick - t);}    // ms since the given time, INFINITY for neverTick
         float learningRate;                  // Used as a factor when synapse weight is changed
         float presynapticTraceDecay, postsynapticTraceDecay; // When a synapse (presynaptic) or neuron (postsynaptic) is fired a trace is left. This trace decays exponentially by these rates
         float presynapticFactor, postsynapticFactor;         // How much the trace variables are factored into the plasticity function
 
+        // Plasticity rule, shared by the whole network (see NeuCor_Plasticity.h). Each rule has its own specialized kernels.
+        // PLASTICITY_TRACE is the original rule, using the trace variables above. The STDP rules use stdp. All are scaled by learningRate.
+        enum plasticityRules { PLASTICITY_TRACE, PLASTICITY_NEAREST_ADDITIVE, PLASTICITY_NEAREST_MULTIPLICATIVE, PLASTICITY_TRIPLET, PLASTICITY_count };
+        void setPlasticityRule(plasticityRules rule);
+        plasticityRules getPlasticityRule() const;
+        struct STDPParameters {
+            float aPlus = 0.02f, aMinus = 0.03f;            // Potentiation and depression amplitudes
+            float tauPlus = 16.8f, tauMinus = 33.7f;        // Time constants (ms) of the pair windows
+            float aTriplet = 0.02f, tauY = 114.0f;          // Triplet rule: extra potentiation, and time constant (ms) of the slow postsynaptic trace
+        };
+        STDPParameters stdp;
+
         // This is how input signals interface with the brain. Every given input has a position in the brain, which is used to determined what nearby neurons are fired.
         // Input rate is defined in Hz as floats. Since the memory address of the array (inputs) is what's stored, the brain will use the updated values automatically.
         // If the inputs positions are NULL, they are generated randomly and input radius is 1.0
         void setInputRateArray(float inputs[], unsigned inputCount, coord3 inputPositions[] = nullptr, float inputRadius[] = nullptr);
         void addInputOffset(unsigned inputID, float t);    // Adds time offset (in ms) to a given input
 
+        // Input schedules are defined in simulated time, and evaluated when the inputs schedule their firings. This makes them independent
+        // of how often and how far run() is called. Every call adds a segment to the input's schedule, which is in effect from the given time (ms)
+        // until the next segment of the same input starts. Before its first segment, an input follows the input rate array.
+        void scheduleInputRate(unsigned inputID, float time, float rate);      // Constant rate (Hz). A sequence of these gives a piecewise trajectory
+        void scheduleInputRandomWalk(unsigned inputID, float time, float startRate, float step, float interval, float minRate = 0.0f, float maxRate = INFINITY); // Every interval (ms) the rate changes by a uniform random amount in [-step, step]
+        void scheduleInputLink(unsigned inputID, float time, unsigned sourceID); // Same rate as another input. Links must not form cycles
+        void clearInputSchedule(unsigned inputID);                             // Input follows the input rate array again
+        float getInputRate(unsigned inputID) const;                            // Rate (Hz) of the most recently scheduled firings of an input
+
+        // Lock-free injection of timed events from other threads, e.g. sensor producers. Call enableStimuli() before any producer starts.
+        // Injected events are collected at the start of every run() and applied in time order at their simulated time (ms).
+        // Events for times which have already passed are applied at the start of the step. The inject functions return false if the queue is full.
+        void enableStimuli(std::size_t capacity = std::size_t(1) << 16);
+        bool injectSpike(std::size_t neuronID, float time);                    // Fires a neuron
+        bool injectCurrent(std::size_t neuronID, float time, float potential); // Adds potential (mV) to a neuron
+        bool injectInputRate(unsigned inputID, float time, float rate);        // Sets an input's rate (Hz) from the given time on, like scheduleInputRate()
+
         void setDetectors(unsigned detectorNumber, coord3 detectorPositions[] = nullptr, float detectorRadius[] = nullptr);
         float getDetectorVoltage(unsigned ID);
         std::vector<float> getDetectorVoltages();
 
-        void createNeuron(coord3 position);  // Creates neuron at given coordinates
-        void createSynapse(std::size_t toID, std::size_t fromID, float weight);
+        // Neuron model, shared by the whole network (see NeuCor_Models.h). Each model has its own specialized update kernel.
+        // Can only be changed before anything has been simulated or queued; returns false otherwise. Resets all neurons to rest.
+        enum neuronModels { NEURON_MODEL_STANDARD, NEURON_MODEL_LIF, NEURON_MODEL_IZHIKEVICH, NEURON_MODEL_count };
+        bool setNeuronModel(neuronModels model);
+        neuronModels getNeuronModel() const;
+
+        // Fixed point kernels (see NeuCor_Fixed.h). Potentials, traces and weights are updated with integer arithmetic only, so seeded
+        // simulations give the same results with any compiler, flags and target, native or wasm. Supports the standard and LIF models,
+        // and all plasticity rules. Can only be changed before anything has been simulated or queued; returns false otherwise, and for the Izhikevich model.
+        bool setFixedPoint(bool enable);
+        bool isFixedPoint() const;
+
+        NeuronHandle createNeuron(coord3 position, unsigned type = 0);  // Creates neuron of given type at given coordinates
+
+        // Neuron types. Type 0 is created with the network, with the trace decay rate postsynapticTraceDecay had then.
+        // Changing a type changes every neuron of that type. A neuron's type can be changed at any time.
+        unsigned addNeuronType(const NeuronType& type);                // Returns the new type's index
+        const NeuronType& getNeuronType(unsigned type) const;
+        void setNeuronType(unsigned type, const NeuronType& parameters);
+        unsigned getNeuronTypeCount() const;
+        void assignNeuronType(std::size_t neuronID, unsigned type);
+        void createSynapse(std::size_t toID, std::size_t fromID, float weight); // Deferred to a quiet point if the parent neuron has spikes in flight
+
+        // Structural edits are safe at any time, including from within run(). Deleted neurons and synapses are tombstoned:
+        // queued events for them are skipped, and they are removed from their vectors at the start of a later run(),
+        // once their parent neuron has no spikes in flight (so no queued event points into the vector being compacted).
+        // A deleted neuron's ID is only reused after that.
+        void deleteNeuron(std::size_t ID);
+        void deleteSynapse(std::size_t fromID, std::size_t toID);
+        NeuronHandle getNeuronHandle(std::size_t ID) const;
+        SynapseHandle getSynapseHandle(std::size_t fromID, std::size_t toID) const;
+        bool isAlive(NeuronHandle handle) const;
+        bool isAlive(SynapseHandle handle) const;
+
+        // Renumbers neurons along a Z-order (Morton) curve through their positions, so that neurons which are close in space,
+        // and thus connected, are close in memory too. Deleted neurons are moved last. Done at construction, before connections are made.
+        // Every ID in the network is rewritten (synapses, inputs, detectors, queued events, observers), and existing handles become dead.
+        // Returns the new ID of every old ID. Producers of injected stimuli have to translate their IDs themselves.
+        std::vector<std::size_t> renumberNeurons();
         void makeConnections();              // Connects all neurons closer than 1 unit to each other.
         std::size_t getNeuronCount() const;
         std::vector<NeuronSnapshot> getNeuronSnapshots() const;
         std::vector<SynapseSnapshot> getSynapseSnapshots() const;
+
+        // Incremental snapshots into caller-owned buffers, which are cleared but keep their memory between calls.
+        // With since = 0 everything is copied, as it is after bulk construction or renumberNeurons() since the epoch since. Otherwise only
+        // neurons whose position, potential or activity changed, or synapses whose weight changed, at or after epoch since. Pass the returned epoch as since in the next call.
+        // Changes made between a call and the next run() are reported again by the next call. Deleted neurons are reported with NAN positions.
+        std::uint64_t getEpoch() const;      // Advanced at the end of every run()
+        std::uint64_t getNeuronSnapshots(std::vector<NeuronSnapshot>& snapshots, std::uint64_t since = 0) const;
+        std::uint64_t getSynapseSnapshots(std::vector<SynapseSnapshot>& snapshots, std::uint64_t since = 0) const;
+
+        // Zero-copy views of the network's own state arrays, indexed by neuron ID. Deleted neurons have NAN positions.
+        // The values follow the network as it runs. Views are invalidated when neurons are created.
+        ArrayView<coord3> getPositionView() const;  // Contiguous coord3 (3 floats), stride sizeof(coord3)
+        ArrayView<float> getPotentialView() const;  // Interleaved with activities: stride 2 floats
+        ArrayView<float> getActivityView() const;   // Interleaved with potentials: stride 2 floats
+
+        // Synapses live in their parent neurons, so these are kept as packed arrays in snapshot order.
+        // getSynapseView() brings them up to date: only the weights changed since the previous call are copied,
+        // unless synapses were created, deleted or flipped (topology changed), in which case everything is repacked.
+        struct SynapseView {
+            ArrayView<float> weights;                // Contiguous, one float per synapse
+            ArrayView<std::uint32_t> fromIDs, toIDs; // Interleaved (from, to) endpoint pairs: stride 2 uint32
+            std::uint64_t topologyVersion;           // Changes whenever the synapse order changes
+        };
+        SynapseView getSynapseView();                // Valid until the next call
         std::vector<InputSnapshot> getInputSnapshots() const;
+
+        void setPerfProfile(PerfProfile* profile);  // Samples hardware counters around the phases of run(). Not owned, nullptr disables sampling
+        std::uint64_t getEventCount() const;        // Number of simulator runs dispatched from the simulation queue so far
+        void setFlightRecorder(FlightRecorder* recorder); // Records every dispatched event and spike in the given ring. Not owned, nullptr disables recording
+        void setPublisher(GenerationPublisher* publisher); // Publishes state generations for reader threads at the end of every run(). Not owned, nullptr disables publishing
+
+        // Running totals published at the end of every run().
+        // These are atomics so that other threads (e.g. MetricsExporter) can read them without locking the simulation.
+        struct Counters {
+            std::atomic<double> time{0.0};                 // Simulated time (ms)
+            std::atomic<std::uint64_t> events{0};          // Dispatched simulation queue entries
+            std::atomic<std::uint64_t> spikes{0};          // Neuron firings
+            std::atomic<std::uint64_t> queueDepth{0};      // Pending simulation queue entries
+            std::atomic<std::uint64_t> neurons{0};
+            std::atomic<std::uint64_t> synapses{0};
+            std::atomic<float> meanWeight{0.0f};
+            std::atomic<std::uint64_t> activeNeurons{0};   // Distinct neurons which fired during the last completed activity window
+        };
+        const Counters& getCounters() const;
+        static constexpr float activityWindow = 100.0f;    // Length (ms) of the windows used for counting active neurons
+
+        // Observers are called at the end of every run() with what happened during the step, as one contiguous span in time order.
+        // An observer restricted to a set of neurons only gets the spikes of those neurons, or the weight changes of synapses from or to them.
+        // Nothing is recorded while no observer of a kind is registered. Observers must not add or remove observers.
+        struct SpikeEvent {
+            double time;                     // ms
+            std::size_t id;                  // Neuron ID
+        };
+        struct WeightEvent {
+            double time;                     // ms
+            std::size_t fromID, toID;
+            float weight;                    // Weight after the change
+        };
+        typedef std::function<void(const SpikeEvent* spikes, std::size_t count)> SpikeObserver;
+        typedef std::function<void(const WeightEvent* changes, std::size_t count)> WeightObserver;
+        unsigned addSpikeObserver(SpikeObserver observer, const std::vector<std::size_t>& neuronIDs = {});   // No neuron IDs observes all neurons. Returns a handle for removeObserver()
+        unsigned addWeightObserver(WeightObserver observer, const std::vector<std::size_t>& neuronIDs = {}); // No neuron IDs observes all synapses
+        void removeObserver(unsigned handle);
     protected:
         friend class simulator;
         friend class Neuron;
@@ -96,8 +334,22 @@ class NeuCor {
         friend struct InputFirer;
         friend struct VoltageDetector;
         friend class NeuCor_Renderer;
+        friend class NeuCor_Validator;
+        friend struct FrameState;
+        friend struct StimulusInjector;
+        friend struct StandardModel;
+        friend struct IzhikevichModel;
+        friend struct FixedStandardModel;
+        friend struct FixedLIFModel;
+        friend struct TraceRule;
+        template <bool> friend struct NearestSpikeRule;
+        friend struct TripletRule;
+        friend struct FixedTraceRule;
+        template <bool> friend struct FixedNearestSpikeRule;
+        friend struct FixedTripletRule;
 
         void queueSimulation(simulator* s, const float time); // Schedules calling run() of simulator s a given number of ms in the future
+        void queueSimulationAt(simulator* s, const tick_t time); // Schedules calling run() of simulator s at a given time (in ticks)
 
         // These are containers used to allocate important values next to each other in a vector,
         // thus making hardware buffering more efficient in the rendering engine.
@@ -111,49 +363,157 @@ class NeuCor {
         float* inputArray;                   // Holds defined input rate array
         unsigned inputArraySize;
         std::vector<InputFirer> inputHandler;
+        float inputArrayRate(unsigned inputID) const;  // Rate in the input rate array, 0 if outside of it
         std::vector<VoltageDetector> voltageDetectors;
 
+        Arena arena;                                                    // Memory of the neurons' synapse containers. Declared before them, so it outlives them
+        std::deque<Arena> bulkArenas;                                   // The same for the neurons of bulk construction, one per chunk, so chunks allocate in parallel
         std::deque<Neuron> neurons;                                     // Where all neurons are stored
+        std::vector<NeuronType> neuronTypes;                            // Indexed by Neuron::type
+        struct TypeTables {                                             // Derived from the parameters of a neuron type
+            APWaveform apWaveform;                                      // Action potential, see StandardModel
+            FixedAPWaveform fixedAPWaveform;                            // The same, Q16.16
+            TraceDecay traceDecay;                                      // Postsynaptic trace decay
+            FixedDecay fixedTraceDecay, fixedRecharge;
+        };
+        std::vector<TypeTables> typeTables;                             // Indexed by Neuron::type, updated with neuronTypes
+        void updateTypeTables(unsigned type, const APWaveform& apWaveform);
+        TraceDecay presynapticDecay;                                    // Of presynapticTraceDecay
+        FixedDecay fixedPresynapticDecay;
+        bool fixedPoint;
+        neuronModels neuronModel;
+        void (*neuronKernel)(Neuron&);                                  // Neuron::kernel() of the neuron model. Called instead of the virtual run()
+        void (*neuronInitializer)(Neuron&, const NeuronType&);          // initialize() of the neuron model
+        void (NeuCor::*drainKernel)(tick_t targetTime);                 // drain() of the neuron model and plasticity rule
+        template <typename Model> void setNeuronKernels();
+        void setDrainKernel();                                          // Of the current model and rule. Called whenever either changes
+        template <typename Model> void setDrainKernel();
+        template <typename Model, typename Rule> void drain(tick_t targetTime);      // Runs the queued events and clock updates up to the target time
+        template <typename Model, typename Rule> inline void dispatch(simulator* s); // Runs a dequeued simulator, neurons and synapses with the model and rule inlined
+        template <typename Model, typename Rule> inline void execute(simulator* s);  // Dispatches, counts and records an event
+        std::vector<std::size_t> clockDriven;                           // IDs of the clock driven neurons of hybrid scheduling, ascending
+        tick_t lastMigration;
+        tick_t nextClockTick;                                           // Next update of the clock driven neurons
+        std::vector<tick_t> clockedUpdates;                             // Reused by Neuron::charge_insynapses_clocked()
+        void migrateNeurons();                                          // Moves neurons between the clock and event driven sets by their rates since lastMigration
+        void releaseClockDriven(Neuron& neuron);                        // Makes a clock driven neuron event driven again
+        plasticityRules plasticityRule;
+        void (*presynapticKernel)(Synapse&);                            // Synapse::presynapticPlasticity() of the plasticity rule
+        void (*firingKernel)(Neuron&);                                  // Neuron::firing() of the plasticity rule. Called by Neuron::fire()
+        template <typename Rule> void setPlasticityKernels();
         Neuron* getNeuron(std::size_t ID);
         const Neuron* getNeuron(std::size_t ID) const;
-        Synapse* getSynapse(std::size_t toID, std::size_t fromID);
-        const Synapse* getSynapse(std::size_t toID, std::size_t fromID) const;
+        Synapse* getSynapse(std::size_t fromID, std::size_t toID);     // nullptr if there is no such synapse, or it has been deleted
+        const Synapse* getSynapse(std::size_t fromID, std::size_t toID) const;
         Synapse* getSynapse(std::pair<std::size_t, std::size_t> ID);
         const Synapse* getSynapse(std::pair<std::size_t, std::size_t> ID) const;
         void queFlip(std::pair<std::size_t, std::size_t>);              // Queues an synapse to be flipped when possible
-
-        void deleteSynapse(std::size_t toID, std::size_t fromID);
-        void deleteNeuron(std::size_t ID);
     private:
-        float currentTime = 0.0;             // Amount of simulated time
+        tick_t currentTick = 0;              // Amount of simulated time
+        std::int64_t ticksPerMs = 1000;
+        double msPerTick = 0.001;
+        bool deterministic = false;
+        std::uint64_t rngState = 0;          // splitmix64 state, used in deterministic mode
+        std::uint32_t queueSequence = 0;     // Number of queued simulations, tie breaker in deterministic mode
+        void generate(int n_neurons);        // Creates and connects the initial neurons
+        void generateBulk(int n_neurons, unsigned threads); // The same for NeuCor(n_neurons, seed, threads), after generate(0)
+        void reserveSimulationQueue();
+        std::uint64_t eventCount = 0;        // Dispatched simulation queue entries
+        PerfProfile* perfProfile = nullptr;
+        FlightRecorder* flightRecorder = nullptr;
+        GenerationPublisher* publisher = nullptr;
+        void recordEvent(const simulator* s, float weightDelta); // Adds a dispatched simulator to the flight recorder
+
+        Counters counters;
+        std::uint64_t spikeCount = 0;
+        double weightSum = 0.0;              // Sum of all synapse weights, kept up to date wherever weights change
+        std::uint64_t synapseCount = 0;
+        std::int64_t activityWindowIndex = 0;
+        std::uint64_t activeInWindow = 0, activeInLastWindow = 0;
+        void countSpike(Neuron& neuron);     // Called by Neuron::fire()
+        void rollActivityWindow();           // Moves to the activity window of the current time
+        void publishCounters();
+
+        std::uint64_t epoch = 1;             // Change tracking epoch, see getEpoch()
+        std::vector<std::pair<std::uint64_t, std::size_t>> changedNeurons; // (epoch, neuron ID) of first changes in an epoch, in epoch order
+        std::vector<std::tuple<std::uint64_t, std::size_t, std::size_t>> changedSynapses; // (epoch, parent ID, target ID)
+        void markChanged(Neuron& neuron);    // Called by the setters at the first change of an epoch (when changedEpoch is outdated)
+        void markChanged(Synapse& synapse);
+        void compactChanges();               // Drops log entries superseded by later changes of the same object
+        std::uint64_t rebuiltEpoch = 0;      // Last epoch in which everything changed, which the logs leave out: snapshots since then copy everything
+        void markAllChanged();               // After bulk construction and renumbering
+
+        std::uint64_t topologyVersion = 0;   // Advanced when synapses are created, deleted or flipped
+        std::uint64_t packedVersion = ~std::uint64_t(0), packedEpoch = 0; // Topology version and epoch of the packed synapse arrays
+        std::vector<float> packedWeights;
+        std::vector<std::uint32_t> packedEnds;
+
+        template <typename Observer, typename Event> struct Subscription {
+            unsigned handle;
+            Observer observer;
+            std::vector<bool> neurons;       // Observed neuron IDs, empty if all are observed
+            std::vector<Event> filtered;     // Reused for the events of observed neurons
+        };
+        unsigned observerHandles = 0;
+        std::vector<Subscription<SpikeObserver, SpikeEvent>> spikeObservers;
+        std::vector<Subscription<WeightObserver, WeightEvent>> weightObservers;
+        std::vector<SpikeEvent> spikeBatch;  // Events of the current step, kept empty while nothing is observed
+        std::vector<WeightEvent> weightBatch;
+        void recordWeight(const Synapse& synapse); // Called wherever plasticity or the user changes a weight
+        void deliverObservations();
+
+        std::unique_ptr<StimulusQueue> stimulusQueue;       // Written by any thread, drained by run()
+        std::unique_ptr<StimulusInjector> stimulusInjector;
+        void drainStimuli();
 
         // Holds vector of simulations, which store memory addresses of simulators and the times when they should be simulated (by calling their run() function).
         // The container is sorted so that the earliest upcoming run() call is first.
         // This assures that everything is simulated in the right order
-        std::priority_queue<simulation, std::vector<simulation>, std::greater<simulation>> simulationQueue;
+        std::priority_queue<simulation, std::vector<simulation>, std::greater<simulation>> simulationQueue; // Storage reserved by generate()
 
         unsigned totalGenNeurons;                                                // Used for determining neuron density at initial generation
         std::vector<std::size_t> freeNeuronIDs;                                  // Deleted neurons, where IDs can be reused
         std::vector<std::pair<std::size_t, std::size_t> > synapseFlippingQueue;  // Synapses which are to should be flipped
+
+        std::vector<std::size_t> compactionQueue;                                // Neurons with tombstoned out synapses
+        std::vector<std::tuple<std::size_t, std::size_t, float>> pendingSynapses; // Deferred createSynapse() calls (from, to, weight)
+        std::uint32_t synapseGenerations = 0;                                    // Generation of the latest created synapse
+        std::size_t deletedNeurons = 0;                                          // Deleted neurons whose IDs haven't been reused yet
+        bool isQuiet(const Neuron& neuron) const;                                // True if no out synapse of the neuron has a queued spike delivery
+        void tombstoneSynapse(Synapse& synapse);
+        void queueCompaction(Neuron& neuron);
+        void compactStructure();                                                 // Applies deferred flips, removals and creations at quiet neurons
 };
 
 // Every timed a future run called is scheduled (queueSimulation()), and instance of this class is stored in the simulationQueue.
 struct simulation {
-    simulation(simulator* sim, float simTime): addr(sim), stime(simTime){};             // Initialises values in member initializer list
+    simulation(simulator* sim, tick_t simTime, std::uint32_t generation, std::uint64_t order = 0, std::uint32_t sequence = 0)
+    : addr(sim), stime(simTime), sequence(sequence), generation(generation), order(order){}; // Initialises values in member initializer list
     simulator* addr;                                                                    // Memory address of simulator about to be run
-    float stime;                                                                        // Scheduled time for simulator to be ran
-    bool operator>(const simulation &otherSim) const {return stime > otherSim.stime;};  // Lets the simulationQueue sort elements with earliest time first
+    tick_t stime;                                                                       // Scheduled time (in ticks) for simulator to be ran
+    std::uint32_t sequence;                                                             // Queueing order. Only set in deterministic mode
+    std::uint32_t generation;                                                           // Generation of the simulator when queued. Skipped if it has changed since
+    std::uint64_t order;                                                                // Simulator type and target ID. Only set in deterministic mode
+    bool operator>(const simulation &otherSim) const {                                  // Lets the simulationQueue sort elements with earliest time first
+        if (stime != otherSim.stime) return stime > otherSim.stime;
+        if (order != otherSim.order) return order > otherSim.order;
+        return sequence > otherSim.sequence;
+    };
 };
 
 // Abstract class which can have future calls to run() function scheduled in simulation queue
 class simulator {
     public:
-        simulator(NeuCor* p);                // Needs pointer to parent network object (NeuCor)
+        enum simulatorType : std::uint8_t { SIMULATOR_NEURON, SIMULATOR_SYNAPSE, SIMULATOR_INPUT, SIMULATOR_OTHER };
+
+        simulator(NeuCor* p, simulatorType type = SIMULATOR_OTHER); // Needs pointer to parent network object (NeuCor)
         virtual ~simulator() = default;
         NeuCor* parentNet;
+        simulatorType type;                  // Identifies queued simulators without RTTI
 
         virtual void run() = 0;              // Run-function which updates the simulator to the current time of parent network
-        float lastRan;                       // Time of the current network when last ran
+        tick_t lastRan;                      // Time (in ticks) of the current network when last ran
+        std::uint32_t generation;            // Changed when the simulated object is deleted or replaced, which makes its queued runs stale
 };
 
 // UNUSED
@@ -164,6 +524,18 @@ struct deletedSimulator: public simulator {
 };
 
 
+// Part of an input's rate schedule, in effect from its start until the next segment of the same input starts
+struct InputSegment {
+    enum segmentModes { SEGMENT_CONSTANT, SEGMENT_RANDOM_WALK, SEGMENT_LINKED };
+    segmentModes mode;
+    tick_t start;
+    float rate;                                             // Constant rate, or initial rate of a random walk (Hz)
+    float step, minRate, maxRate;                           // Random walk: uniform steps in [-step, step], clamped to [minRate, maxRate]
+    tick_t interval;                                        // Random walk: time between steps
+    unsigned source;                                        // Linked: input whose rate is followed
+    std::deque<std::pair<tick_t, float>> walk;              // Random walk: steps taken so far, from the one in effect at the current time
+};
+
 // Every input value in the parent network's input rate array is given an input firer
 // Works to interface between user and neurons
 // Schedule is called every time the brain's run function is called
@@ -174,8 +546,12 @@ struct InputFirer: public simulator {
     float radius;
     std::vector<std::size_t> near;                          // IDs of all neurons closer than radius
 
-    void schedule(float deltaT, float frequency);           // Schedules itself to be run at even intervals (frequency) for the next given ms (deltaT)
-    float lastFire;                                         // The last scheduled time
+    void schedule(float deltaT, float frequency);           // Schedules itself to be run at its scheduled rate, or else at even intervals (frequency), for the next given ms (deltaT)
+    tick_t lastFire;                                        // The last scheduled time (in ticks)
+    std::vector<InputSegment> segments;                     // Rate schedule sorted by start time. Empty if the input follows the input rate array
+    float rate;                                             // Rate (Hz) of the most recently scheduled firings
+    float scheduledRate(tick_t t, tick_t& changeTime, float arrayFrequency, unsigned depth = 0); // Rate at time t. Lowers changeTime to when the rate may change next
+    void scheduleRate(tick_t from, tick_t to, float frequency); // Schedules firings in [from, to) at even intervals
     void run() override;                                    // Runs all neurons in near vector
 };
 
@@ -193,14 +569,17 @@ struct VoltageDetector {
 // Implements Neurons as simulator objects
 class Neuron: public simulator {
     public:
-        Neuron(NeuCor* p, coord3 position);  // Parent network pointer and position coordinate (random if NAN)
+        Neuron(NeuCor* p, coord3 position, unsigned type = 0); // Parent network pointer, position coordinate (random if NAN) and neuron type
+        Neuron(NeuCor* p, std::size_t ID, Arena* arena); // Used by bulk construction, which registers and initializes the neuron itself, in parallel
         ~Neuron() override;
+        Neuron(const Neuron& other) = default;          // Used by NeuCor::renumberNeurons()
         Neuron& operator=(const Neuron& other);
 
         void makeConnections();              // Creates connections to all neurons closer than 1 unit
         void run() override;                 // Updates the neuron to current simulation time
         void fire();                         // Initiates neuron firing sequence, increases activity, updates weight of both incoming and outgoing synapses
         void transfer();                     // Schedule simulation at maximum input voltage from synapses, thus firing if needed. Called by in-synapses
+        template <typename Model> void transfer(); // The same, for the network's event loop, which knows the neuron model
         void givePotential(float pot);       // Instantly adds given amount of potential
         void scheduleFire(float const time);    // Time in future that the neuron will fire
 
@@ -208,8 +587,10 @@ class Neuron: public simulator {
 
         std::size_t pos;
         std::size_t PA;
-        std::vector<Synapse> outSynapses;               // Owns synapses
-        std::map<std::size_t, std::size_t> inSynapses;  // Contains coordinates to synapse in order {from neuron, to neuron}
+        typedef std::vector<Synapse, ArenaAllocator<Synapse>> SynapseVector;
+        typedef std::map<std::size_t, std::size_t, std::less<std::size_t>, ArenaAllocator<std::pair<const std::size_t, std::size_t>>> InSynapseMap;
+        SynapseVector outSynapses;                      // Owns synapses. Allocated from the network's arena
+        InSynapseMap inSynapses;                        // Contains coordinates to synapse in order {from neuron, to neuron}
 
         void removeOutSyn(std::size_t synTo);           // Removes given synapse from outSynapses
         void removeInSyn(std::size_t synFrom);          // Removes given synapse from inSynapses
@@ -222,31 +603,56 @@ class Neuron: public simulator {
         void setActivity(float a);
         void resetActivity();                           // Resets the firings count and sets initial time to current time
         std::size_t getID() const;
+        unsigned getType() const;
+
+        tick_t lastFire;                                // Simulation time (in ticks) when neuron last fired. NeuCor::neverTick before the first spike
+        tick_t previousFire;                            // The spike before lastFire, NeuCor::neverTick if none. Used by the triplet plasticity rule
+        std::int64_t lastActivityWindow;                // Last activity window in which the neuron fired (see NeuCor::activityWindow)
+        std::uint64_t changedEpoch;                     // Last epoch in which position, potential or activity changed (see NeuCor::getEpoch())
+        bool isDeleted() const;
 
-        float lastFire;                                 // Simulation time when neuron last fired
+    protected:
+        friend class NeuCor;
+        friend struct StandardModel;
+        friend struct LIFModel;
+        friend struct IzhikevichModel;
+        friend struct FixedStandardModel;
+        friend struct FixedLIFModel;
+        bool deleted;                                   // Tombstone, set by NeuCor::deleteNeuron() until the ID is reused
+        bool compactionQueued;                          // In NeuCor::compactionQueue
 
     private:
-        std::size_t const ownID;                        // Global ID (index) in container
+        std::size_t ownID;                              // Global ID (index) in container. Only changed by NeuCor::renumberNeurons()
 
-        // Neuron simulation variables:
-        float baselevel, threshold, recharge;           // Base level standard voltage of neuron, voltage threshold needed to fire, exponential growth rate to base level
-        float vesicles, reuptake, buffer;               // Vesicle amount, linear uptake, amount buffered. UNUSED.
-        float AP_h, AP_depolW, AP_polW, AP_deltaPol, AP_depolFac, AP_deltaStart; // Defines form of action potential spike
-        float AP_cutoff;                                // How long after last spike until next is allowed
-        const float traceDecayRate;                     // Rate at which the trace variable decays after spike
+        // Neuron simulation variables. The constant parameters are in the neuron's type:
+        std::uint16_t type;                             // Index in NeuCor::neuronTypes
+        float vesicles;                                 // Vesicle amount. UNUSED.
+        float recovery;                                 // Recovery variable of the Izhikevich model
 
-        float activityStartTime;                        // ms simulation time
+        tick_t activityStartTime;                       // Simulation time (in ticks)
         unsigned firings;                               // Number of firings since activity start time started
 
-        float scheduledFireTime;
-
-        void charge_passive(float deltaT, float currentT);          // Exponential decay/growth towards base level
-        void charge_thresholdCheck(float deltaT, float currentT);   // Checks if neuron should fire, and if so calls fire()
-        void charge_insynapses(float deltaT, float currentT);       // Transfers in-synapses voltages to neurons voltage over time
-
-        void vesicles_uptake(float deltaT);                         // Increases vesicle amount over time
-
-        void AP(float currentT);                                    // Action potential sequence, which is used when to determine voltage when firing
+        tick_t scheduledFireTime;                       // Set by scheduleFire(), NeuCor::neverTick if none
+        std::uint32_t recentDeliveries;                 // Spikes delivered since the last migration of hybrid scheduling
+        bool clockDriven;                               // In NeuCor::clockDriven
+        tick_t lastCharged;                             // While clock driven, the last time it would have been run if event driven
+
+        const NeuronType& parameters() const;           // The neuron's type. update() loads it once and passes it on
+        void initialize();                              // The state of a new neuron, from its type. Only touches the neuron and its potAct entries
+
+        template <typename Model> void update();        // The body of run() for a neuron model, defined in NeuCor_Models.h
+        template <typename Model> static void kernel(Neuron& neuron) {neuron.update<Model>();} // Plain function, so the network can call it through a function pointer
+        template <typename Rule> void fire();           // The body of fire() for a plasticity rule, which is applied to the in-synapses inline
+        template <typename Rule> static void firing(Neuron& neuron) {neuron.fire<Rule>();}
+        void charge_insynapses(const NeuronType& t, float deltaT, tick_t currentT);     // Transfers in-synapses voltages to neurons voltage over time
+        void charge_insynapses_fixed(const NeuronType& t, tick_t deltaT, tick_t currentT); // The same in fixed point, for a duration in ticks
+        // Clock driven neurons of hybrid scheduling: charge as charge_insynapses() would have if the neuron had stayed event driven, and been
+        // run at every delivery and AP_cutoff ms after it (see transfer()). So the charge doesn't depend on the clock period.
+        void charge_insynapses_clocked(const NeuronType& t, tick_t deltaT, tick_t currentT, bool leaky);
+        void charge_insynapses_clocked_fixed(const NeuronType& t, tick_t deltaT, tick_t currentT);
+        void clockedUpdateTimes(tick_t currentT, tick_t cutoff, std::vector<tick_t>& updates) const; // Those runs since lastCharged, ascending
+        void vesicles_uptake(const NeuronType& t, float deltaT);                        // Increases vesicle amount over time
+        void vesicles_uptake_fixed(const NeuronType& t, tick_t deltaT);                 // The same in fixed point, for a duration in ticks
 };
 
 // Implements Synapses as simulator objects.
@@ -255,23 +661,36 @@ class Neuron: public simulator {
 class Synapse: public simulator {
     public:
         Synapse(NeuCor* p, std::size_t parent, std::size_t target); // ID of neuron where synapse comes from (parent), and where it goes (target)
+        Synapse(NeuCor* p, std::size_t parent, std::size_t target, float weight, float length, std::uint32_t generation); // Used by bulk construction, which does the network's bookkeeping (inSynapses entry, counters, change log) itself
         Synapse(const Synapse &other);
         Synapse& operator=(const Synapse &other);
         ~Synapse() override;
 
         void run() override;                                        // Delivers voltage to target neuron at right time
+        template <typename Model, typename Rule> void deliver();    // The same, for the network's event loop, which knows the neuron model and plasticity rule
         void fire(float polW, float depolFac, float deltaStart);    // Gets spike shape information (polarization width, depolarization factor, spike time offset). Schedules itself to run at delivery time
 
         float getWeight() const;
         void setWeight(float w);
+        bool isDeleted() const;
     protected:
         friend class NeuCor;
         friend class Neuron;
         friend class NeuCor_Renderer;
-
-        void synapticPlasticity();                      // Called when spike is delivered, and when parent neuron fires. Changes the weight of the synapse
-        float averageSynapseTrace, averageNeuronTrace;
-        unsigned synapticPlasticityCalls;
+        friend struct FrameState;
+        friend struct TraceRule;
+        template <bool> friend struct NearestSpikeRule;
+        friend struct TripletRule;
+        friend struct FixedTraceRule;
+        template <bool> friend struct FixedNearestSpikeRule;
+        friend struct FixedTripletRule;
+
+        // Plasticity kernels of a rule, defined in NeuCor_Plasticity.h. Called when a spike is delivered, and when the target neuron fires
+        template <typename Rule> static void presynapticPlasticity(Synapse& synapse);
+        template <typename Rule> static void postsynapticPlasticity(Synapse& synapse);
+        void applyWeightChange(float weightChange);     // Scales by the learning rate, clamps and records the new weight
+        void applyFixedWeightChange(std::int64_t weightChange); // The same for a change with FixedPoint::factorBits fractional bits
+        void weightChanged(float oldWeight);            // Records a weight change of the above
 
         float getPrePot() const;                        // Used by renderer to show parent end voltage
         float getPostPot() const;                       // Used by renderer to show target end voltage
@@ -281,12 +700,15 @@ class Synapse: public simulator {
 
         std::size_t pN;                                 // Parent neuron ID
         std::size_t tN;                                 // Target neuron ID
-        float lastSpikeStart;                           // Simulation time when synapse receives spike
-        float lastSpikeArrival;                         // Simulation time when last spike arrived
-
-        float AP_polW, AP_depolFac, AP_deltaStart, AP_fireTime; // Shape of the action potential (spike). Mostly inherited from parent neuron
+        tick_t lastSpikeStart;                          // Simulation time (in ticks) when synapse receives spike
+        tick_t lastSpikeArrival;                        // Simulation time (in ticks) when last spike arrived. NeuCor::neverTick before the first arrival
+
+        float AP_polW, AP_depolFac, AP_deltaStart;      // Shape of the action potential (spike). Mostly inherited from parent neuron
+        tick_t AP_fireTime;                             // Delivery time (in ticks) of the spike in flight, 0 if none
+        std::uint64_t changedEpoch;                     // Last epoch in which the weight changed
+        std::size_t packedIndex;                        // Index in the packed synapse arrays (see NeuCor::getSynapseView())
+        bool deleted;                                   // Tombstone, until the parent neuron's synapses are compacted
         float AP_speed;                                         // ms/unit of spike
-        const float traceDecayRate;
         bool inhibitory;
     private:
         float length;                                   // Length between parent and target neuron
@@ -0,0 +1,75 @@
+#include "NeuCor_Arena.h"
+
+#include <assert.h>
+
+static_assert(alignof(std::max_align_t) <= Arena::minBlock, "Blocks must be aligned for any type");
+
+Arena::Arena(std::size_t slabSize)
+:cursor(nullptr), slabEnd(nullptr), slabSize(slabSize), inUse(0) {
+    assert(maxBlock <= slabSize);
+    for (std::size_t i = 0; i<classCount; i++) freeLists[i] = nullptr;
+}
+
+Arena::~Arena(){
+    for (char* slab: slabs) ::operator delete(slab);
+}
+
+std::size_t Arena::sizeClass(std::size_t bytes){
+    std::size_t c = 0;
+    for (std::size_t size = minBlock; size < bytes; size <<= 1) c++;
+    return c;
+}
+
+void* Arena::allocate(std::size_t bytes){
+    if (maxBlock < bytes) return ::operator new(bytes);
+
+    const std::size_t c = sizeClass(bytes);
+    const std::size_t size = minBlock << c;
+    inUse += size;
+    if (freeLists[c] != nullptr){
+        FreeBlock* block = freeLists[c];
+        freeLists[c] = block->next;
+        return block;
+    }
+
+    if (static_cast<std::size_t>(slabEnd - cursor) < size){
+        // The rest of the slab goes to the free lists of smaller classes instead of being wasted.
+        // Every block size is a multiple of minBlock, so the remainder splits up exactly
+        while (cursor != nullptr && minBlock <= static_cast<std::size_t>(slabEnd - cursor)){
+            std::size_t r = sizeClass(slabEnd - cursor);
+            if ((minBlock << r) > static_cast<std::size_t>(slabEnd - cursor)) r--;
+            FreeBlock* block = reinterpret_cast<FreeBlock*>(cursor);
+            block->next = freeLists[r];
+            freeLists[r] = block;
+            cursor += minBlock << r;
+        }
+        slabs.push_back(static_cast<char*>(::operator new(slabSize)));
+        cursor = slabs.back();
+        slabEnd = cursor + slabSize;
+    }
+    void* block = cursor;
+    cursor += size;
+    return block;
+}
+
+void Arena::deallocate(void* block, std::size_t bytes){
+    if (block == nullptr) return;
+    if (maxBlock < bytes){
+        ::operator delete(block);
+        return;
+    }
+
+    const std::size_t c = sizeClass(bytes);
+    FreeBlock* freed = static_cast<FreeBlock*>(block);
+    freed->next = freeLists[c];
+    freeLists[c] = freed;
+    inUse -= minBlock << c;
+}
+
+std::size_t Arena::getReserved() const {
+    return slabs.size()*slabSize;
+}
+
+std::size_t Arena::getInUse() const {
+    return inUse;
+}
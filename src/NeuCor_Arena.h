@@ -0,0 +1,67 @@
+#ifndef NEUCOR_ARENA_H
+#define NEUCOR_ARENA_H
+
+#include <cstddef>
+#include <new>
+#include <vector>
+
+// Pool allocator for the many small containers of a network (synapse vectors, in-synapse map nodes).
+// Memory is carved from large slabs into power-of-two size classes. Freed blocks go on a free list of their
+// class and are reused by the next allocation of that class, so growing vectors and map nodes don't
+// fragment the heap. All slabs are released at once when the arena is destroyed.
+// Not thread safe: an arena must only be used by the thread that owns its network.
+class Arena {
+    public:
+        Arena(std::size_t slabSize = 256*1024);
+        ~Arena();                                       // Releases every slab, whether or not its blocks were deallocated
+        Arena(const Arena&) = delete;
+        Arena& operator=(const Arena&) = delete;
+
+        void* allocate(std::size_t bytes);              // Blocks larger than maxBlock come from operator new
+        void deallocate(void* block, std::size_t bytes); // Bytes must be the size the block was allocated with
+
+        std::size_t getReserved() const;                // Bytes held in slabs
+        std::size_t getInUse() const;                   // Bytes of slab blocks currently allocated, rounded up to their size class
+
+        static constexpr std::size_t minBlock = 16;
+        static constexpr std::size_t maxBlock = 16*1024;
+
+    private:
+        static constexpr std::size_t classCount = 11;   // minBlock, 2*minBlock, ... maxBlock
+        static std::size_t sizeClass(std::size_t bytes);
+
+        struct FreeBlock {
+            FreeBlock* next;
+        };
+        FreeBlock* freeLists[classCount];
+        std::vector<char*> slabs;
+        char* cursor;                                   // Unused part of the newest slab
+        char* slabEnd;
+        std::size_t slabSize;
+        std::size_t inUse;
+};
+
+// Standard allocator drawing from an Arena. Default constructed allocators (no arena) use operator new,
+// so containers can still be built outside of a network.
+template <typename T>
+struct ArenaAllocator {
+    typedef T value_type;
+    Arena* arena;
+
+    ArenaAllocator(Arena* arena = nullptr): arena(arena) {}
+    template <typename U> ArenaAllocator(const ArenaAllocator<U>& other): arena(other.arena) {}
+
+    T* allocate(std::size_t n){
+        if (arena == nullptr) return static_cast<T*>(::operator new(n*sizeof(T)));
+        return static_cast<T*>(arena->allocate(n*sizeof(T)));
+    }
+    void deallocate(T* p, std::size_t n){
+        if (arena == nullptr) ::operator delete(p);
+        else arena->deallocate(p, n*sizeof(T));
+    }
+
+    template <typename U> bool operator==(const ArenaAllocator<U>& other) const { return arena == other.arena; }
+    template <typename U> bool operator!=(const ArenaAllocator<U>& other) const { return arena != other.arena; }
+};
+
+#endif // NEUCOR_ARENA_H
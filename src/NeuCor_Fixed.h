@@ -0,0 +1,117 @@
+#ifndef NEUCOR_FIXED_H
+#define NEUCOR_FIXED_H
+
+#include <cstdint>
+#include <cmath>
+
+#include "NeuCor_Waveforms.h"
+
+// 2^(i/256) for i in [0, 256], with 30 fractional bits. Generated at compile time
+struct Exp2Table {
+    std::int64_t entries[257] = {};
+    constexpr Exp2Table(){
+        for (int i = 0; i<=256; i++) entries[i] = static_cast<std::int64_t>(constexprExp(0.6931471805599453*i/256.0)*double(std::int64_t(1) << 30) + 0.5);
+    }
+};
+inline constexpr Exp2Table exp2Table;
+
+// Integer arithmetic of the fixed point kernels (see NeuCor::setFixedPoint()).
+// Potentials, vesicles and activities are Q16.16 and weights have 23 fractional bits. These are kernels, not a storage format: the values
+// are kept in the existing float fields, which hold them exactly (at most 24 significant bits), so the state, the API and the renderer's
+// potAct buffer are shared with the float kernels. Every kernel converts its inputs to integers, computes with integers only and stores
+// an exact result, so results don't depend on compiler flags, FMA contraction or the target. Factors such as decays have 30 fractional
+// bits, and base 2 exponents 24. Float parameters are rounded to fixed point where they are used.
+// Fixed point policies derive from FixedPoint, which is how Neuron::update() and the plasticity kernels tell them apart.
+struct FixedPoint {
+    static constexpr int potentialBits = 16, weightBits = 23, factorBits = 30, exponentBits = 24;
+    static constexpr std::int64_t one = std::int64_t(1) << factorBits;       // 1.0 as a factor
+    static constexpr std::int64_t saturation = std::int64_t(1) << 62;       // Results that overflow are clamped to +-saturation
+
+    static std::int64_t toFixed(float value, int bits){
+        return std::llround(double(value)*double(std::int64_t(1) << bits));
+    }
+    static float toFloat(std::int64_t value, int bits){                     // Exact while value has at most 24 significant bits
+        if (INT32_MAX < value) value = INT32_MAX;
+        if (value < INT32_MIN) value = INT32_MIN;
+        return static_cast<float>(value)/static_cast<float>(std::int64_t(1) << bits);
+    }
+
+    // a*b/2^bits, rounded towards zero, saturated
+    static std::int64_t mul(std::int64_t a, std::int64_t b, int bits){
+        const std::int64_t limit = std::int64_t(1) << 31;
+        if (!(-limit < a && a < limit && -limit < b && b < limit)){
+            // Magnitudes as unsigned, which also holds INT64_MIN's
+            const std::uint64_t magnitudeA = a < 0 ? 0 - std::uint64_t(a) : std::uint64_t(a);
+            const std::uint64_t magnitudeB = b < 0 ? 0 - std::uint64_t(b) : std::uint64_t(b);
+            if (magnitudeA != 0 && std::uint64_t(INT64_MAX)/magnitudeA < magnitudeB)
+                return (a < 0) != (b < 0) ? -saturation : saturation;
+        }
+        return a*b/(std::int64_t(1) << bits);
+    }
+
+    // 2^(exponent/2^exponentBits) as a factor. The fraction is interpolated in a table of 2^(i/256): accurate to about 2^-20, but at most to one unit (2^-30) for small results
+    static std::int64_t exp2(std::int64_t exponent){
+        if ((std::int64_t(31) << exponentBits) <= exponent) return saturation;
+        const std::int64_t mask = (std::int64_t(1) << exponentBits) - 1;
+        const std::int64_t fraction = exponent & mask;
+        const std::int64_t whole = (exponent - fraction)/(std::int64_t(1) << exponentBits);
+        if (whole <= -62) return 0;
+
+        const std::int64_t i = fraction >> (exponentBits - 8), rest = fraction & ((std::int64_t(1) << (exponentBits - 8)) - 1);
+        const std::int64_t* const table = exp2Table.entries;
+        const std::int64_t mantissa = table[i] + (((table[i+1] - table[i])*rest) >> (exponentBits - 8));
+        return 0 <= whole ? mantissa << whole : mantissa >> -whole;
+    }
+
+    // base^(ticks/ticksPerMs) as a factor, where log2PerMs is log2(base) with exponentBits fractional bits. Negative ticks give the inverse
+    static std::int64_t power(std::int64_t log2PerMs, std::int64_t ticks, std::int64_t ticksPerMs){
+        if (log2PerMs == 0) return one;
+        const std::int64_t whole = ticks/ticksPerMs, rest = ticks%ticksPerMs;
+        if ((std::int64_t(64) << exponentBits)/(log2PerMs < 0 ? -log2PerMs : log2PerMs) < whole) return log2PerMs < 0 ? 0 : saturation;
+        return exp2(whole*log2PerMs + rest*log2PerMs/ticksPerMs);
+    }
+
+    // e^(-ms/tau) as a factor, for a duration in ticks
+    static std::int64_t expDecay(float tau, std::int64_t ticks, std::int64_t ticksPerMs){
+        if (!(0.0f < tau)) return ticks == 0 ? one : 0;
+        const std::int64_t log2PerMs = std::llround(-double(std::int64_t(1) << exponentBits)/(double(tau)*0.6931471805599453));
+        return power(log2PerMs, ticks, ticksPerMs);
+    }
+};
+
+// rate^ms as a factor, for a rate per ms. log2(rate) is only recomputed when the rate changes
+class FixedDecay {
+    public:
+        std::int64_t operator()(float rate, std::int64_t ticks, std::int64_t ticksPerMs){
+            if (!(0.0f < rate)) return ticks == 0 ? FixedPoint::one : 0; // Everything decays at once, and log2 doesn't exist
+            if (rate != cachedRate){
+                cachedRate = rate;
+                log2PerMs = std::llround(std::log2(double(rate))*double(std::int64_t(1) << FixedPoint::exponentBits));
+            }
+            return FixedPoint::power(log2PerMs, ticks, ticksPerMs);
+        }
+    private:
+        float cachedRate = NAN;
+        std::int64_t log2PerMs = 0;
+};
+
+// A Waveform with fixed point samples, over a range of ticks starting at 0. Interpolated with integers
+template <std::size_t N>
+struct FixedWaveform {
+    std::int32_t samples[N+1] = {};
+
+    FixedWaveform() = default;
+    FixedWaveform(const Waveform<N>& waveform, int bits){
+        for (std::size_t i = 0; i<=N; i++) samples[i] = static_cast<std::int32_t>(FixedPoint::toFixed(waveform.samples[i], bits));
+    }
+
+    std::int64_t operator()(std::int64_t x, std::int64_t range) const {
+        if (x <= 0 || range <= 0) return samples[0];
+        if (range <= x) return samples[N];
+        const std::int64_t position = x*std::int64_t(N);
+        const std::int64_t i = position/range, rest = position%range;
+        return samples[i] + (std::int64_t(samples[i+1]) - samples[i])*rest/range;
+    }
+};
+
+#endif // NEUCOR_FIXED_H
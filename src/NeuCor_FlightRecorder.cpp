@@ -0,0 +1,192 @@
+#include "NeuCor_FlightRecorder.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+
+#if !defined(__EMSCRIPTEN__) && (defined(__unix__) || defined(__APPLE__))
+#define NEUCOR_FLIGHT_SIGNALS 1
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+namespace {
+const char rawMagic[4] = {'N', 'C', 'F', 'R'};
+struct RawHeader {
+    char magic[4];
+    std::uint32_t entrySize;
+    std::uint64_t count;                                // Entries following the header, oldest first
+    std::uint64_t recorded;
+};
+
+const char* typeNames[FlightRecorder::EVENT_count] = {"neuron", "synapse", "input", "other", "spike"};
+
+#ifdef NEUCOR_FLIGHT_SIGNALS
+FlightRecorder* installedRecorder = nullptr;
+char installedPath[4096];
+volatile sig_atomic_t usr1Received = 0;
+
+bool writeAll(int fd, const void* data, std::size_t size){
+    const char* bytes = static_cast<const char*>(data);
+    while (size != 0){
+        ssize_t written = write(fd, bytes, size);
+        if (written <= 0) return false;
+        bytes += written;
+        size -= written;
+    }
+    return true;
+}
+
+void fatalSignalHandler(int sig){
+    if (installedRecorder != nullptr){
+        int fd = open(installedPath, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd != -1){
+            installedRecorder->dumpRaw(fd);
+            close(fd);
+        }
+        installedRecorder = nullptr;
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+void usr1SignalHandler(int){
+    usr1Received = 1;
+}
+#endif
+}
+
+FlightRecorder::FlightRecorder(std::size_t capacity)
+:head(0) {
+    std::size_t size = 1;
+    while (size < capacity) size <<= 1;
+    entries.reset(new Entry[size]());
+    mask = size - 1;
+}
+
+FlightRecorder::~FlightRecorder(){
+#ifdef NEUCOR_FLIGHT_SIGNALS
+    if (installedRecorder == this) installedRecorder = nullptr;
+#endif
+}
+
+std::size_t FlightRecorder::capacity() const {
+    return mask + 1;
+}
+
+std::uint64_t FlightRecorder::recorded() const {
+    return head.load(std::memory_order_acquire);
+}
+
+void FlightRecorder::snapshot(std::vector<Entry>& out) const {
+    const std::uint64_t end = head.load(std::memory_order_acquire);
+    const std::uint64_t count = std::min<std::uint64_t>(end, capacity());
+    const std::uint64_t start = end - count;
+
+    out.resize(count);
+    for (std::uint64_t i = 0; i<count; i++) out[i] = entries[(start + i) & mask];
+
+    // The writer may have lapped the oldest copied entries meanwhile, including the one it is writing now
+    const std::uint64_t after = head.load(std::memory_order_acquire);
+    if (capacity() <= after + 1 - start){
+        const std::uint64_t overwritten = std::min<std::uint64_t>(count, after + 1 - capacity() - start);
+        out.erase(out.begin(), out.begin() + overwritten);
+    }
+}
+
+void FlightRecorder::dump(std::ostream& out) const {
+    std::vector<Entry> copy;
+    snapshot(copy);
+    out<<"# Flight record: "<<copy.size()<<" of "<<recorded()<<" events\n";
+    print(out, copy);
+}
+
+bool FlightRecorder::dump(const std::string& path) const {
+    std::ofstream file(path);
+    if (!file) return false;
+    dump(file);
+    return bool(file);
+}
+
+bool FlightRecorder::dumpRaw(int fd) const {
+#ifdef NEUCOR_FLIGHT_SIGNALS
+    const std::uint64_t end = head.load(std::memory_order_acquire);
+    const std::uint64_t count = std::min<std::uint64_t>(end, capacity());
+    const std::uint64_t start = (end - count) & mask;
+
+    RawHeader header;
+    std::memcpy(header.magic, rawMagic, sizeof(rawMagic));
+    header.entrySize = sizeof(Entry);
+    header.count = count;
+    header.recorded = end;
+    if (!writeAll(fd, &header, sizeof(header))) return false;
+
+    // The ring is written in at most two parts: from the oldest entry to the end of the buffer, and the wrapped rest
+    const std::uint64_t firstPart = std::min<std::uint64_t>(count, capacity() - start);
+    return writeAll(fd, &entries[start], firstPart*sizeof(Entry))
+        && writeAll(fd, &entries[0], (count - firstPart)*sizeof(Entry));
+#else
+    (void) fd;
+    return false;
+#endif
+}
+
+bool FlightRecorder::readRaw(const std::string& path, std::vector<Entry>& out){
+    std::ifstream file(path, std::ios::binary);
+    RawHeader header;
+    if (!file.read(reinterpret_cast<char*>(&header), sizeof(header))) return false;
+    if (std::memcmp(header.magic, rawMagic, sizeof(rawMagic)) != 0 || header.entrySize != sizeof(Entry)) return false;
+
+    out.resize(header.count);
+    file.read(reinterpret_cast<char*>(out.data()), header.count*sizeof(Entry));
+    out.resize(file.gcount()/sizeof(Entry)); // A dump cut short by a crash still yields its complete entries
+    return true;
+}
+
+void FlightRecorder::print(std::ostream& out, const std::vector<Entry>& entries){
+    out<<"# time_ms type target source weight_delta\n";
+    out<<std::fixed;
+    for (const Entry &e: entries){
+        out<<std::setprecision(4)<<e.time<<' '<<(e.type < EVENT_count ? typeNames[e.type] : "?")<<' '<<e.target<<' ';
+        if (e.source == noSource) out<<'-';
+        else out<<e.source;
+        out<<' '<<std::setprecision(6)<<e.weightDelta<<'\n';
+    }
+    out<<std::defaultfloat;
+}
+
+void FlightRecorder::installSignalHandlers(const std::string& path){
+    dumpPath = path;
+#ifdef NEUCOR_FLIGHT_SIGNALS
+    std::strncpy(installedPath, path.c_str(), sizeof(installedPath)-1);
+    installedPath[sizeof(installedPath)-1] = '\0';
+    installedRecorder = this;
+
+    struct sigaction action;
+    std::memset(&action, 0, sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = fatalSignalHandler;
+    sigaction(SIGABRT, &action, nullptr);
+    sigaction(SIGSEGV, &action, nullptr);
+    action.sa_handler = usr1SignalHandler;
+    action.sa_flags = SA_RESTART;
+    sigaction(SIGUSR1, &action, nullptr);
+#endif
+}
+
+bool FlightRecorder::dumpRequested(){
+#ifdef NEUCOR_FLIGHT_SIGNALS
+    if (usr1Received && installedRecorder == this){
+        usr1Received = 0;
+        return true;
+    }
+#endif
+    return false;
+}
+
+const std::string& FlightRecorder::signalDumpPath() const {
+    return dumpPath;
+}
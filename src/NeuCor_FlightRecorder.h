@@ -0,0 +1,76 @@
+#ifndef NEUCOR_FLIGHTRECORDER_H
+#define NEUCOR_FLIGHTRECORDER_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Fixed-size ring of the most recent simulation events, for post-mortem analysis of pathological runs.
+// There is a single writer (the thread running NeuCor::run()) which never blocks or allocates, so the
+// recorder can stay enabled under production load. Readers copy the ring without locking and discard
+// entries which were overwritten while copying.
+// The ring can be dumped on demand, as text at the next step after SIGUSR1, or from a SIGABRT (failed assert)
+// or SIGSEGV handler. Crash dumps are raw binary; use readRaw() and print() to turn them into text.
+class FlightRecorder {
+    public:
+        enum eventType : std::uint8_t {
+            EVENT_NEURON,                               // Neuron::run() dispatched from the queue
+            EVENT_SYNAPSE,                              // Synapse::run(), i.e. spike delivery
+            EVENT_INPUT,                                // InputFirer::run()
+            EVENT_OTHER,
+            EVENT_SPIKE,                                // Neuron::fire()
+            EVENT_count
+        };
+
+        struct Entry {
+            double time;                                // Simulated time (ms)
+            float weightDelta;                          // Change of the summed network weight caused by the event
+            std::uint32_t target;                       // Neuron ID, or input index for EVENT_INPUT
+            std::uint32_t source;                       // Presynaptic neuron ID for EVENT_SYNAPSE, otherwise noSource
+            std::uint8_t type;
+        };
+        static constexpr std::uint32_t noSource = 0xFFFFFFFF;
+
+        FlightRecorder(std::size_t capacity = std::size_t(1) << 21); // Rounded up to a power of two
+        ~FlightRecorder();
+        FlightRecorder(const FlightRecorder&) = delete;
+        FlightRecorder& operator=(const FlightRecorder&) = delete;
+
+        inline void record(eventType type, std::uint32_t target, double time, float weightDelta = 0.0f, std::uint32_t source = noSource){
+            const std::uint64_t index = head.load(std::memory_order_relaxed);
+            Entry& entry = entries[index & mask];
+            entry.time = time;
+            entry.weightDelta = weightDelta;
+            entry.target = target;
+            entry.source = source;
+            entry.type = type;
+            head.store(index + 1, std::memory_order_release);
+        }
+
+        std::size_t capacity() const;
+        std::uint64_t recorded() const;                 // Total number of events recorded, including overwritten ones
+        void snapshot(std::vector<Entry>& out) const;   // Copies the retained events, oldest first
+
+        void dump(std::ostream& out) const;             // Text dump, oldest first
+        bool dump(const std::string& path) const;
+        bool dumpRaw(int fd) const;                     // Binary dump using only write(), safe to call from signal handlers
+        static bool readRaw(const std::string& path, std::vector<Entry>& out);
+        static void print(std::ostream& out, const std::vector<Entry>& entries);
+
+        // Dumps this recorder in binary to path on SIGABRT and SIGSEGV, and sets dumpRequested() on SIGUSR1,
+        // after which NeuCor::run() writes a text dump to path + ".txt". Only one recorder can be installed at a time.
+        void installSignalHandlers(const std::string& path);
+        bool dumpRequested();                           // True once after each SIGUSR1. Checked by NeuCor::run() at step boundaries
+        const std::string& signalDumpPath() const;
+
+    private:
+        std::unique_ptr<Entry[]> entries;
+        std::uint64_t mask;
+        std::atomic<std::uint64_t> head;
+        std::string dumpPath;
+};
+
+#endif // NEUCOR_FLIGHTRECORDER_H
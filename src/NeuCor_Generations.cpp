@@ -0,0 +1,88 @@
+#include "NeuCor_Generations.h"
+
+#include <cassert>
+
+GenerationPublisher::Pin::Pin(GenerationPublisher* publisher, unsigned slot)
+:publisher(publisher), slot(slot) {}
+
+GenerationPublisher::Pin::Pin(Pin&& other)
+:publisher(other.publisher), slot(other.slot) {
+    other.publisher = nullptr;
+}
+
+GenerationPublisher::Pin& GenerationPublisher::Pin::operator=(Pin&& other){
+    if (this != &other){
+        release();
+        publisher = other.publisher;
+        slot = other.slot;
+        other.publisher = nullptr;
+    }
+    return *this;
+}
+
+GenerationPublisher::Pin::~Pin(){
+    release();
+}
+
+void GenerationPublisher::Pin::release(){
+    if (publisher) publisher->slots[slot].pins.fetch_sub(1, std::memory_order_release);
+    publisher = nullptr;
+}
+
+GenerationPublisher::GenerationPublisher(unsigned slots)
+:slots(new Slot[slots]), slotCount(slots), current(noSlot), next(0), interval(0.0f),
+lastPublished(-INFINITY), publishedTicks(NeuCor::neverTick), published(0), skipped(0) {
+    assert(2 <= slots);
+}
+
+GenerationPublisher::Pin GenerationPublisher::acquire(){
+    while (true){
+        unsigned const slot = current.load();
+        if (slot == noSlot) return Pin();
+        slots[slot].pins.fetch_add(1);
+        // The writer only reuses slots which are neither pinned nor current, so if the slot is still current after
+        // pinning, it can't have been overwritten in between
+        if (current.load() == slot) return Pin(this, slot);
+        slots[slot].pins.fetch_sub(1);
+    }
+}
+
+void GenerationPublisher::publish(const NeuCor& network){
+    if (network.getTime() < lastPublished + interval) return;
+
+    unsigned const latest = current.load();
+    unsigned slot = noSlot;
+    for (unsigned i = 0; i<slotCount; i++){
+        unsigned const candidate = (next + i) % slotCount;
+        if (candidate != latest && slots[candidate].pins.load() == 0){
+            slot = candidate;
+            break;
+        }
+    }
+    if (slot == noSlot){
+        skipped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    next = (slot + 1) % slotCount;
+
+    FrameState& state = slots[slot].state;
+    state.capture(network, publishedTicks); // Reuses the memory of the reclaimed generation
+    state.sequence = published.load(std::memory_order_relaxed) + 1;
+    publishedTicks = state.ticks;
+    lastPublished = state.time;
+
+    current.store(slot);
+    published.fetch_add(1, std::memory_order_relaxed);
+}
+
+void GenerationPublisher::setInterval(float newInterval){
+    interval = newInterval;
+}
+
+std::uint64_t GenerationPublisher::getPublished() const {
+    return published.load(std::memory_order_relaxed);
+}
+
+std::uint64_t GenerationPublisher::getSkipped() const {
+    return skipped.load(std::memory_order_relaxed);
+}
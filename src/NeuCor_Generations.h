@@ -0,0 +1,63 @@
+#ifndef NEUCOR_GENERATIONS_H
+#define NEUCOR_GENERATIONS_H
+
+#include "NeuCor.h"
+#include "NeuCor_SimulationThread.h"
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+
+// Publishes read-only generations of a network's state at step boundaries, for any number of reader threads.
+// A reader pins the latest generation and can keep it as long as it likes, without ever blocking the simulation.
+// Generations live in a fixed set of slots. The simulation writes the next generation into a slot that no reader
+// has pinned, so an unused generation is reclaimed by being overwritten. If every slot is pinned, the step isn't published.
+class GenerationPublisher {
+    public:
+        // Pinned generation, released when destroyed. Empty if nothing has been published yet
+        class Pin {
+            public:
+                Pin() = default;
+                Pin(Pin&& other);
+                Pin& operator=(Pin&& other);
+                ~Pin();
+
+                explicit operator bool() const {return publisher != nullptr;}
+                const FrameState& operator*() const {return publisher->slots[slot].state;}
+                const FrameState* operator->() const {return &publisher->slots[slot].state;}
+
+            private:
+                friend class GenerationPublisher;
+                Pin(GenerationPublisher* publisher, unsigned slot);
+                void release();
+                GenerationPublisher* publisher = nullptr;
+                unsigned slot = 0;
+        };
+
+        GenerationPublisher(unsigned slots = 8);  // At least 2, so that one is free while the latest generation is pinned
+        GenerationPublisher(const GenerationPublisher&) = delete;
+        GenerationPublisher& operator=(const GenerationPublisher&) = delete;
+
+        Pin acquire();                             // Latest generation. Any thread, never blocks (retries only if a publication overtakes it)
+        void publish(const NeuCor& network);       // Called by NeuCor::run() at the end of every step (see NeuCor::setPublisher())
+        void setInterval(float interval);          // Least simulated ms between publications, 0 publishes every step
+        std::uint64_t getPublished() const;        // Number of generations published
+        std::uint64_t getSkipped() const;          // Steps not published because every slot was pinned
+
+    private:
+        struct Slot {
+            FrameState state;
+            std::atomic<unsigned> pins{0};
+        };
+        std::unique_ptr<Slot[]> slots;
+        unsigned slotCount;
+        static constexpr unsigned noSlot = ~0u;
+        std::atomic<unsigned> current;             // Slot of the latest generation
+        unsigned next;                             // Where the writer starts looking for a free slot
+        float interval;
+        double lastPublished;                      // Simulated time (ms) of the latest generation
+        tick_t publishedTicks;
+        std::atomic<std::uint64_t> published, skipped;
+};
+
+#endif // NEUCOR_GENERATIONS_H
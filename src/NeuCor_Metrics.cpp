@@ -0,0 +1,214 @@
+#include "NeuCor_Metrics.h"
+#include "NeuCor.h"
+
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+#if !defined(__EMSCRIPTEN__) && (defined(__linux__) || defined(__APPLE__))
+#define NEUCOR_METRICS_HTTP 1
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
+
+namespace {
+void writeMetric(std::ostringstream& out, const char* name, const char* type, const char* help, double value){
+    out<<"# HELP "<<name<<' '<<help<<'\n';
+    out<<"# TYPE "<<name<<' '<<type<<'\n';
+    out<<name<<' '<<value<<'\n';
+}
+
+// Resident set size in bytes, 0 if unknown
+std::uint64_t residentMemory(){
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    std::uint64_t size = 0, resident = 0;
+    if (statm>>size>>resident) return resident*static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+    return 0;
+}
+}
+
+MetricsExporter::MetricsExporter(const NeuCor* network)
+:network(network), stopRequested(false), listenSocket(-1), havePrevious(false),
+previousTime(0.0), previousEvents(0), previousSpikes(0) {}
+
+MetricsExporter::~MetricsExporter(){
+    stop();
+}
+
+bool MetricsExporter::start(const Options& newOptions){
+    stop();
+    options = newOptions;
+
+    if (options.httpPort != 0 && !openHttp()){
+        std::cerr<<"Metrics: could not listen on 127.0.0.1:"<<options.httpPort<<'\n';
+        options.httpPort = 0;
+    }
+    if (options.filePath.empty() && options.httpPort == 0) return false;
+
+    stopRequested = false;
+    thread = std::thread(&MetricsExporter::loop, this);
+    return true;
+}
+
+void MetricsExporter::stop(){
+    if (thread.joinable()){
+        {
+            std::lock_guard<std::mutex> lock(stopMutex);
+            stopRequested = true;
+        }
+        stopSignal.notify_all();
+        thread.join();
+    }
+    closeHttp();
+}
+
+bool MetricsExporter::running() const {
+    return thread.joinable();
+}
+
+std::string MetricsExporter::sample(){
+    const NeuCor::Counters& c = network->getCounters();
+    const double time = c.time.load(std::memory_order_relaxed);
+    const std::uint64_t events = c.events.load(std::memory_order_relaxed);
+    const std::uint64_t spikes = c.spikes.load(std::memory_order_relaxed);
+    const std::chrono::steady_clock::time_point wall = std::chrono::steady_clock::now();
+
+    std::lock_guard<std::mutex> lock(sampleMutex);
+    double realTimeFactor = 0.0, eventRate = 0.0, spikeRate = 0.0;
+    if (havePrevious){
+        const double seconds = std::chrono::duration<double>(wall - previousWall).count();
+        if (0.0 < seconds){
+            realTimeFactor = (time - previousTime)/1000.0/seconds;
+            eventRate = double(events - previousEvents)/seconds;
+            spikeRate = double(spikes - previousSpikes)/seconds;
+        }
+    }
+    havePrevious = true;
+    previousWall = wall, previousTime = time, previousEvents = events, previousSpikes = spikes;
+
+    std::ostringstream out;
+    out.precision(15);
+    writeMetric(out, "neucor_simulated_time_ms", "gauge", "Simulated time in milliseconds.", time);
+    writeMetric(out, "neucor_real_time_factor", "gauge", "Simulated seconds per wall clock second since the previous sample.", realTimeFactor);
+    writeMetric(out, "neucor_events_total", "counter", "Simulation queue entries dispatched.", double(events));
+    writeMetric(out, "neucor_events_per_second", "gauge", "Dispatched events per wall clock second since the previous sample.", eventRate);
+    writeMetric(out, "neucor_spikes_total", "counter", "Neuron firings.", double(spikes));
+    writeMetric(out, "neucor_spikes_per_second", "gauge", "Neuron firings per wall clock second since the previous sample.", spikeRate);
+    writeMetric(out, "neucor_queue_depth", "gauge", "Pending simulation queue entries.", double(c.queueDepth.load(std::memory_order_relaxed)));
+    writeMetric(out, "neucor_neurons", "gauge", "Live neurons.", double(c.neurons.load(std::memory_order_relaxed)));
+    writeMetric(out, "neucor_synapses", "gauge", "Live synapses.", double(c.synapses.load(std::memory_order_relaxed)));
+    writeMetric(out, "neucor_mean_weight", "gauge", "Mean synapse weight.", c.meanWeight.load(std::memory_order_relaxed));
+    writeMetric(out, "neucor_active_neurons", "gauge", "Neurons which fired during the last completed activity window.", double(c.activeNeurons.load(std::memory_order_relaxed)));
+    writeMetric(out, "neucor_resident_memory_bytes", "gauge", "Resident set size of the process.", double(residentMemory()));
+
+    lastText = out.str();
+    return lastText;
+}
+
+void MetricsExporter::loop(){
+    const std::chrono::milliseconds interval(static_cast<long>(options.interval*1000.0f));
+    std::chrono::steady_clock::time_point nextSample = std::chrono::steady_clock::now();
+
+    while (true){
+        if (nextSample <= std::chrono::steady_clock::now()){
+            const std::string text = sample();
+            if (!options.filePath.empty() && !writeFile(text))
+                std::cerr<<"Metrics: could not write "<<options.filePath<<'\n';
+            nextSample += interval;
+        }
+
+        if (options.httpPort != 0){ // Poll the socket in short slices so that stop requests are noticed
+            serveHttp(100);
+            std::lock_guard<std::mutex> lock(stopMutex);
+            if (stopRequested) return;
+        }
+        else {
+            std::unique_lock<std::mutex> lock(stopMutex);
+            if (stopSignal.wait_until(lock, nextSample, [this]{return stopRequested;})) return;
+        }
+    }
+}
+
+bool MetricsExporter::writeFile(const std::string& text) const {
+    const std::string temporaryPath = options.filePath + ".tmp";
+    FILE* file = fopen(temporaryPath.c_str(), "w");
+    if (file == NULL) return false;
+
+    bool written = fwrite(text.data(), 1, text.size(), file) == text.size();
+    written = fclose(file) == 0 && written;
+    if (!written){
+        remove(temporaryPath.c_str());
+        return false;
+    }
+    return rename(temporaryPath.c_str(), options.filePath.c_str()) == 0; // Readers see either the old or the new file, never a partial one
+}
+
+bool MetricsExporter::openHttp(){
+#ifdef NEUCOR_METRICS_HTTP
+    listenSocket = socket(AF_INET, SOCK_STREAM, 0);
+    if (listenSocket == -1) return false;
+
+    int reuse = 1;
+    setsockopt(listenSocket, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+
+    sockaddr_in address = {};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(options.httpPort);
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (bind(listenSocket, reinterpret_cast<sockaddr*>(&address), sizeof(address)) != 0 || listen(listenSocket, 4) != 0){
+        closeHttp();
+        return false;
+    }
+    return true;
+#else
+    return false;
+#endif
+}
+
+void MetricsExporter::serveHttp(int timeoutMs){
+#ifdef NEUCOR_METRICS_HTTP
+    pollfd listener = {listenSocket, POLLIN, 0};
+    if (poll(&listener, 1, timeoutMs) <= 0) return;
+
+    int client = accept(listenSocket, NULL, NULL);
+    if (client == -1) return;
+
+    char request[1024];
+    pollfd readable = {client, POLLIN, 0};
+    if (0 < poll(&readable, 1, 1000)) recv(client, request, sizeof(request), 0); // Every path returns the metrics, the request itself is not inspected
+
+    std::string body;
+    {
+        std::lock_guard<std::mutex> lock(sampleMutex);
+        body = lastText;
+    }
+    std::ostringstream response;
+    response<<"HTTP/1.0 200 OK\r\n"
+            <<"Content-Type: text/plain; version=0.0.4\r\n"
+            <<"Content-Length: "<<body.size()<<"\r\n"
+            <<"Connection: close\r\n\r\n"
+            <<body;
+    const std::string text = response.str();
+#ifdef MSG_NOSIGNAL
+    send(client, text.data(), text.size(), MSG_NOSIGNAL);
+#else
+    send(client, text.data(), text.size(), 0);
+#endif
+    ::close(client);
+#else
+    (void) timeoutMs;
+#endif
+}
+
+void MetricsExporter::closeHttp(){
+#ifdef NEUCOR_METRICS_HTTP
+    if (listenSocket != -1) ::close(listenSocket);
+#endif
+    listenSocket = -1;
+}
@@ -0,0 +1,59 @@
+#ifndef NEUCOR_METRICS_H
+#define NEUCOR_METRICS_H
+
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+
+class NeuCor;
+
+// Exports Prometheus text format metrics of a running network from a background thread.
+// The thread only reads the atomic counters published by NeuCor::run() (see NeuCor::Counters),
+// so the simulation loop is never locked. Metrics are either written atomically to a file
+// (write to temporary file, then rename) or served on a loopback HTTP port, or both.
+class MetricsExporter {
+    public:
+        struct Options {
+            std::string filePath;                   // Metrics file, empty to disable
+            unsigned short httpPort = 0;            // Port on 127.0.0.1, 0 to disable
+            float interval = 5.0f;                  // Seconds between samples
+        };
+
+        MetricsExporter(const NeuCor* network);
+        ~MetricsExporter();                         // Stops the thread
+        MetricsExporter(const MetricsExporter&) = delete;
+        MetricsExporter& operator=(const MetricsExporter&) = delete;
+
+        bool start(const Options& options);         // Starts the background thread. Returns false if neither output could be set up
+        void stop();
+        bool running() const;
+
+        std::string sample();                       // Takes a sample now and returns it in text format. Rates are relative to the previous sample
+    private:
+        const NeuCor* network;
+        Options options;
+
+        std::thread thread;
+        std::mutex stopMutex;
+        std::condition_variable stopSignal;
+        bool stopRequested;
+        int listenSocket;
+
+        std::mutex sampleMutex;                     // Guards the previous sample and last text, shared by the file and HTTP outputs
+        bool havePrevious;
+        std::chrono::steady_clock::time_point previousWall;
+        double previousTime;
+        std::uint64_t previousEvents, previousSpikes;
+        std::string lastText;
+
+        void loop();
+        bool writeFile(const std::string& text) const;
+        bool openHttp();
+        void serveHttp(int timeoutMs);             // Answers pending HTTP requests, waiting at most timeoutMs for one
+        void closeHttp();
+};
+
+#endif // NEUCOR_METRICS_H
@@ -0,0 +1,233 @@
+#ifndef NEUCOR_MODELS_H
+#define NEUCOR_MODELS_H
+
+#include "NeuCor.h"
+
+#include <cmath>
+#include <type_traits>
+
+// Neuron model policies (see NeuCor::setNeuronModel()).
+// A policy's integrate() advances a neuron's own dynamics by deltaT ms, after the in-synapse potentials have been added,
+// and fires it if needed. initialize() puts a neuron in its resting state. leaky tells whether integrate() decays the potential
+// by the type's recharge rate, which hybrid scheduling needs to charge like event driven runs (see Neuron::charge_insynapses_clocked()). Every policy is compiled into its own
+// Neuron::update<Model>() kernel, where it is inlined; the network calls the kernel of its model through a function pointer instead of the virtual run().
+
+// The original model: exponential decay towards base level, and a stereotyped action potential shape for AP_cutoff ms after each spike.
+// Firing needs vesicles. The action potential is looked up in a table sampled per neuron type (NeuCor::TypeTables).
+struct StandardModel {
+    static constexpr bool leaky = true;
+
+    // Potential over the AP_cutoff ms after a spike: two Gaussians, plus a linear fall from threshold during the first ms
+    static constexpr APWaveform waveform(const NeuronType& t){
+        return sampleWaveform<APWaveform::size>([t](double sinceFire){
+            const double depolarization = constexprExp(-(sinceFire - t.AP_deltaStart)*(sinceFire - t.AP_deltaStart)/(2.0*t.AP_depolW*t.AP_depolW));
+            const double polarization = constexprExp(-(sinceFire - t.AP_deltaStart - t.AP_deltaPol)*(sinceFire - t.AP_deltaStart - t.AP_deltaPol)/(2.0*t.AP_polW*t.AP_polW));
+            return t.AP_h*(depolarization - polarization*t.AP_depolFac) + t.baselevel + (t.threshold - t.baselevel)*(sinceFire < 1.0 ? 1.0-sinceFire : 0.0);
+        }, 0.0f, t.AP_cutoff);
+    }
+    static const APWaveform defaultWaveform;                                // Of the default parameters, generated at compile time
+
+    static void initialize(Neuron& n, const NeuronType& t){
+        n.setPotential(t.baselevel);
+    }
+
+    static void integrate(Neuron& n, const NeuronType& t, float deltaT, tick_t currentT){
+        // Exponentially decays/grows neuron potential towards base level
+        n.setPotential(((float) n.potential()-t.baselevel) * powf(t.recharge, deltaT) + t.baselevel);
+
+        // Checks if neuron potential is above threshold, and if so fires neuron
+        if ( (t.threshold < n.potential() || n.scheduledFireTime == currentT)
+            && (n.lastFire == NeuCor::neverTick || t.AP_cutoff < n.parentNet->toMs(currentT-n.lastFire)) && 0.0 < n.vesicles)
+                n.fire();
+
+        // If neuron is firing, shapes the action potential by setting the potential
+        if (n.lastFire == NeuCor::neverTick) return;
+        float const sinceFire = n.parentNet->toMs(currentT-n.lastFire);
+        if (t.AP_cutoff < sinceFire) return;
+
+        n.setPotential(n.parentNet->typeTables[n.type].apWaveform(sinceFire));
+    }
+};
+
+inline constexpr APWaveform StandardModel::defaultWaveform = StandardModel::waveform(NeuronType());
+
+// Leaky integrate and fire: the same exponential leak, but a spike only resets the potential to resetPotential,
+// where it is held for AP_cutoff ms (the refractory period). The cheapest model to update.
+struct LIFModel {
+    static constexpr bool leaky = true;
+
+    static void initialize(Neuron& n, const NeuronType& t){
+        n.setPotential(t.baselevel);
+    }
+
+    static void integrate(Neuron& n, const NeuronType& t, float deltaT, tick_t currentT){
+        if (n.lastFire != NeuCor::neverTick && n.parentNet->toMs(currentT-n.lastFire) <= t.AP_cutoff){
+            n.setPotential(t.resetPotential);
+            return;
+        }
+
+        n.setPotential((n.potential()-t.baselevel) * powf(t.recharge, deltaT) + t.baselevel);
+        if (t.threshold < n.potential() || n.scheduledFireTime == currentT){
+            n.fire();
+            n.setPotential(t.resetPotential);
+        }
+    }
+};
+
+// Izhikevich's two variable model (potential v and recovery u), with parameters izhA to izhD, integrated with forward Euler steps
+// of at most 0.5 ms. Spikes when v reaches 30 mV. Strong inhibition is clamped at -100 mV, below which the steps would overshoot.
+// While v is above threshold the upswing may still turn into a spike without further input, so the neuron is then run again after a step.
+// A neuron that has been quiet for long would need thousands of steps to catch up. Instead, once it is close to its resting point,
+// the rest of the update is solved in closed form on the linearisation around that point, so catching up takes at most as many
+// steps as settling does.
+struct IzhikevichModel {
+    static constexpr float peak = 30.0f;
+    static constexpr float minPotential = -100.0f;
+    static constexpr float maxStep = 0.5f;
+    static constexpr bool leaky = false;
+    static constexpr float settled = 0.5f;                          // Largest distance (mV, and the same for u) from the resting point solved in closed form
+
+    static void initialize(Neuron& n, const NeuronType& t){
+        n.setPotential(t.izhC);
+        n.recovery = t.izhB*t.izhC;
+    }
+
+    // The resting point of a type's parameters, and the Jacobian there, if the point is stable
+    struct RestingPoint {
+        bool stable;
+        double v, u;
+        double j00, j01, j10, j11;
+    };
+    static RestingPoint restingPoint(const NeuronType& t){
+        RestingPoint rest = {};
+        const double discriminant = (5.0-t.izhB)*(5.0-t.izhB) - 4.0*0.04*140.0; // Of 0.04v^2 + (5-b)v + 140 = 0, with u = bv
+        if (discriminant < 0.0) return rest;
+        rest.v = (-(5.0-t.izhB) - std::sqrt(discriminant))/0.08, rest.u = t.izhB*rest.v;
+        rest.j00 = 0.08*rest.v + 5.0, rest.j01 = -1.0, rest.j10 = t.izhA*t.izhB, rest.j11 = -t.izhA;
+        rest.stable = rest.j00 + rest.j11 < 0.0 && 0.0 < rest.j00*rest.j11 - rest.j01*rest.j10;
+        return rest;
+    }
+
+    // Moves (v, u) the given ms along the linearisation around a stable resting point: exp(J time) = c I + s (J - half I),
+    // from the eigenvalues half +- sqrt(half^2 - determinant) of the Jacobian J
+    static void relax(const RestingPoint& rest, float& v, float& u, double time){
+        const double half = (rest.j00 + rest.j11)/2.0, split = half*half - (rest.j00*rest.j11 - rest.j01*rest.j10);
+        double c, s;
+        if (0.0 < split){
+            const double root = std::sqrt(split), fast = std::exp((half-root)*time), slow = std::exp((half+root)*time);
+            c = (slow + fast)/2.0, s = (slow - fast)/(2.0*root);
+        }
+        else if (split < 0.0){
+            const double frequency = std::sqrt(-split), decay = std::exp(half*time);
+            c = decay*std::cos(frequency*time), s = decay*std::sin(frequency*time)/frequency;
+        }
+        else c = std::exp(half*time), s = time*c;
+
+        const double dv = v - rest.v, du = u - rest.u;
+        v = rest.v + c*dv + s*((rest.j00 - half)*dv + rest.j01*du);
+        u = rest.u + c*du + s*(rest.j10*dv + (rest.j11 - half)*du);
+    }
+
+    static void integrate(Neuron& n, const NeuronType& t, float deltaT, tick_t currentT){
+        float v = fmax(n.potential(), minPotential), u = n.recovery;
+        bool fired = false;
+        if (n.scheduledFireTime == currentT) v = peak;
+
+        const int steps = static_cast<int>(ceilf(deltaT/maxStep));
+        const float h = deltaT/steps;
+        const RestingPoint rest = 2 < steps ? restingPoint(t) : RestingPoint{};
+        for (int i = 0; i<steps && v < peak; i++){
+            if (rest.stable && 2 < steps-i && std::abs(v - rest.v) <= settled && std::abs(u - rest.u) <= settled){
+                relax(rest, v, u, double(steps-i)*h);
+                break;
+            }
+            v += h*(0.04f*v*v + 5.0f*v + 140.0f - u);
+            u += h*t.izhA*(t.izhB*v - u);
+        }
+        if (peak <= v){
+            n.fire();
+            v = t.izhC;
+            u += t.izhD;
+            fired = true;
+        }
+
+        n.setPotential(v);
+        n.recovery = u;
+        if (!fired && t.threshold < v) n.parentNet->queueSimulation(&n, maxStep);
+    }
+};
+
+// Fixed point versions of StandardModel and LIFModel (see NeuCor::setFixedPoint()), for a duration in ticks.
+// The potential is kept in Q16.16, the decay is an integer power and the action potential an integer interpolation of the type's table.
+struct FixedStandardModel: FixedPoint {
+    static void integrate(Neuron& n, const NeuronType& t, tick_t deltaT, tick_t currentT){
+        NeuCor* const net = n.parentNet;
+        NeuCor::TypeTables& tables = net->typeTables[n.type];
+        const std::int64_t baselevel = toFixed(t.baselevel, potentialBits);
+        std::int64_t potential = toFixed(n.potential(), potentialBits);
+        potential = baselevel + mul(potential - baselevel, tables.fixedRecharge(t.recharge, deltaT, net->ticksPerMs), factorBits);
+
+        const tick_t cutoff = net->toTicks(t.AP_cutoff);
+        if ( (toFixed(t.threshold, potentialBits) < potential || n.scheduledFireTime == currentT)
+            && (n.lastFire == NeuCor::neverTick || cutoff < currentT-n.lastFire) && 0.0 < n.vesicles)
+                n.fire();
+
+        if (n.lastFire != NeuCor::neverTick && currentT-n.lastFire <= cutoff)
+            potential = tables.fixedAPWaveform(currentT-n.lastFire, cutoff);
+        n.setPotential(toFloat(potential, potentialBits));
+    }
+};
+
+struct FixedLIFModel: FixedPoint {
+    static void integrate(Neuron& n, const NeuronType& t, tick_t deltaT, tick_t currentT){
+        NeuCor* const net = n.parentNet;
+        if (n.lastFire != NeuCor::neverTick && currentT-n.lastFire <= net->toTicks(t.AP_cutoff)){
+            n.setPotential(toFloat(toFixed(t.resetPotential, potentialBits), potentialBits));
+            return;
+        }
+
+        const std::int64_t baselevel = toFixed(t.baselevel, potentialBits);
+        std::int64_t potential = toFixed(n.potential(), potentialBits);
+        potential = baselevel + mul(potential - baselevel, net->typeTables[n.type].fixedRecharge(t.recharge, deltaT, net->ticksPerMs), factorBits);
+        if (toFixed(t.threshold, potentialBits) < potential || n.scheduledFireTime == currentT){
+            n.fire();
+            potential = toFixed(t.resetPotential, potentialBits);
+        }
+        n.setPotential(toFloat(potential, potentialBits));
+    }
+};
+
+template <typename Model>
+void Neuron::update(){
+    if (deleted) return;
+    // Determine time
+    tick_t const currentT = parentNet->getTicks();
+    if (currentT == lastRan) return; // Exit function if no time has passed
+    tick_t const deltaTicks = currentT - lastRan;
+    float const deltaT = parentNet->toMs(deltaTicks);
+    lastRan = currentT;
+
+    const NeuronType& t = parameters();
+    if constexpr (std::is_base_of<FixedPoint, Model>::value){
+        if (clockDriven) charge_insynapses_clocked_fixed(t, deltaTicks, currentT);
+        else charge_insynapses_fixed(t, deltaTicks, currentT);
+        Model::integrate(*this, t, deltaTicks, currentT);
+        vesicles_uptake_fixed(t, deltaTicks);
+        setActivity(FixedPoint::toFloat((std::int64_t(firings)*10*parentNet->ticksPerMs << FixedPoint::potentialBits)/(currentT-activityStartTime), FixedPoint::potentialBits));
+        return;
+    }
+    else {
+        // Integrates the potentials of the input synapses
+        if (clockDriven) charge_insynapses_clocked(t, deltaTicks, currentT, Model::leaky);
+        else charge_insynapses(t, deltaT, currentT);
+        // The model's own dynamics, including firing
+        Model::integrate(*this, t, deltaT, currentT);
+    }
+    // Increases vesicles amount
+    vesicles_uptake(t, deltaT);
+
+    // Update activity
+    setActivity(firings/(parentNet->toMs(currentT-activityStartTime)/10.0));
+}
+
+#endif // NEUCOR_MODELS_H
@@ -0,0 +1,216 @@
+#include "NeuCor_Perf.h"
+
+#include <cassert>
+#include <cerrno>
+#include <cstring>
+#include <iomanip>
+
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+#define NEUCOR_PERF_EVENTS 1
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace {
+const char* counterNames[PerfProfile::COUNTER_count] = {"cycles", "instructions", "LLC misses", "branch misses"};
+
+#ifdef NEUCOR_PERF_EVENTS
+int openCounter(std::uint64_t config, int groupFd){
+    perf_event_attr attr;
+    std::memset(&attr, 0, sizeof(attr));
+    attr.size = sizeof(attr);
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.config = config;
+    attr.disabled = groupFd == -1 ? 1 : 0;              // The leader starts the whole group
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+
+    return static_cast<int>(syscall(__NR_perf_event_open, &attr, 0, -1, groupFd, 0));
+}
+#endif
+}
+
+PerfProfile::PerfProfile()
+:groupFd(-1), groupSize(0) {
+    fds.fill(-1);
+    groupSlot.fill(-1);
+
+    sections.resize(PHASE_count);
+    sections.at(PHASE_PREPARE).name = "run: prepare";
+    sections.at(PHASE_DRAIN).name = "run: drain queue";
+    reset();
+
+    open();
+}
+
+PerfProfile::~PerfProfile(){
+    close();
+}
+
+void PerfProfile::open(){
+#ifdef NEUCOR_PERF_EVENTS
+    const std::uint64_t configs[COUNTER_count] = {
+        PERF_COUNT_HW_CPU_CYCLES,
+        PERF_COUNT_HW_INSTRUCTIONS,
+        PERF_COUNT_HW_CACHE_MISSES,                     // Last level cache misses on most PMUs
+        PERF_COUNT_HW_BRANCH_MISSES,
+    };
+
+    for (int c = 0; c<COUNTER_count; c++){
+        int fd = openCounter(configs[c], groupFd);
+        if (fd == -1){
+            if (reason.empty()) reason = std::string(counterNames[c]) + ": " + std::strerror(errno);
+            continue;
+        }
+        if (groupFd == -1) groupFd = fd;
+        fds[c] = fd;
+        groupSlot[c] = groupSize++;
+    }
+
+    if (groupFd != -1){
+        ioctl(groupFd, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(groupFd, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+    if (groupSize == COUNTER_count) reason.clear();
+#else
+    reason = "perf events are only supported on Linux";
+#endif
+}
+
+void PerfProfile::close(){
+#ifdef NEUCOR_PERF_EVENTS
+    if (groupFd != -1) ioctl(groupFd, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+    for (int &fd: fds){
+        if (fd != -1) ::close(fd);
+        fd = -1;
+    }
+#endif
+    groupFd = -1;
+    groupSize = 0;
+}
+
+void PerfProfile::read(std::array<std::uint64_t, COUNTER_count>& out) const {
+    out.fill(0);
+#ifdef NEUCOR_PERF_EVENTS
+    if (groupFd == -1) return;
+
+    std::uint64_t buffer[3 + COUNTER_count];              // {nr, time_enabled, time_running, values...}
+    if (::read(groupFd, buffer, sizeof(buffer)) < static_cast<ssize_t>((3 + groupSize) * sizeof(std::uint64_t))) return;
+
+    double scale = 1.0;
+    if (buffer[2] != 0 && buffer[2] < buffer[1]) scale = double(buffer[1])/double(buffer[2]); // Counters were multiplexed
+
+    for (int c = 0; c<COUNTER_count; c++){
+        if (groupSlot[c] != -1) out[c] = static_cast<std::uint64_t>(double(buffer[3 + groupSlot[c]])*scale);
+    }
+#endif
+}
+
+bool PerfProfile::available() const {
+    return groupFd != -1;
+}
+
+bool PerfProfile::counterAvailable(counter c) const {
+    return fds.at(c) != -1;
+}
+
+const std::string& PerfProfile::unavailableReason() const {
+    return reason;
+}
+
+unsigned PerfProfile::addSection(const std::string& name){
+    sections.emplace_back();
+    sections.back().name = name;
+    sections.back().counts.fill(0);
+    sections.back().events = 0;
+    sections.back().calls = 0;
+    sections.back().seconds = 0.0;
+    sections.back().running = false;
+    return sections.size()-1;
+}
+
+void PerfProfile::begin(unsigned section){
+    Section& s = sections.at(section);
+    assert(!s.running);
+    s.running = true;
+    s.startTime = std::chrono::steady_clock::now();
+    read(s.startCounts);
+}
+
+void PerfProfile::end(unsigned section, std::uint64_t events){
+    std::array<std::uint64_t, COUNTER_count> now;
+    read(now);
+    std::chrono::steady_clock::time_point endTime = std::chrono::steady_clock::now();
+
+    Section& s = sections.at(section);
+    assert(s.running);
+    s.running = false;
+    for (int c = 0; c<COUNTER_count; c++){
+        if (s.startCounts[c] < now[c]) s.counts[c] += now[c] - s.startCounts[c];
+    }
+    s.events += events;
+    s.calls++;
+    s.seconds += std::chrono::duration<double>(endTime - s.startTime).count();
+}
+
+void PerfProfile::addEvents(unsigned section, std::uint64_t events){
+    sections.at(section).events += events;
+}
+
+void PerfProfile::reset(){
+    for (auto &s: sections){
+        s.counts.fill(0);
+        s.events = 0;
+        s.calls = 0;
+        s.seconds = 0.0;
+        s.running = false;
+    }
+}
+
+const PerfProfile::Section& PerfProfile::getSection(unsigned section) const {
+    return sections.at(section);
+}
+
+std::size_t PerfProfile::getSectionCount() const {
+    return sections.size();
+}
+
+void PerfProfile::report(std::ostream& out) const {
+    out<<"Performance counters";
+    if (!available()) out<<" (hardware counters unavailable: "<<reason<<")";
+    else if (!reason.empty()) out<<" (partially unavailable: "<<reason<<")";
+    out<<'\n';
+
+    for (const auto &s: sections){
+        if (s.calls == 0) continue;
+        const double perEvent = s.events != 0 ? 1.0/double(s.events) : 0.0;
+
+        out<<"  "<<s.name<<": "<<s.calls<<" calls, "<<s.events<<" events, "
+           <<std::fixed<<std::setprecision(3)<<s.seconds*1000.0<<" ms";
+        if (s.events != 0) out<<", "<<std::setprecision(1)<<s.seconds*1.0e9*perEvent<<" ns/event";
+        out<<'\n';
+
+        if (!available()) continue;
+        out<<"    ";
+        for (int c = 0; c<COUNTER_count; c++){
+            if (!counterAvailable(static_cast<counter>(c))) continue;
+            out<<counterNames[c]<<"/event: "<<std::setprecision(2)<<double(s.counts[c])*perEvent<<"  ";
+        }
+        if (counterAvailable(COUNTER_CYCLES) && counterAvailable(COUNTER_INSTRUCTIONS) && s.counts[COUNTER_CYCLES] != 0)
+            out<<"IPC: "<<std::setprecision(2)<<double(s.counts[COUNTER_INSTRUCTIONS])/double(s.counts[COUNTER_CYCLES]);
+        out<<'\n';
+    }
+    out<<std::defaultfloat;
+}
+
+PerfProfile::Scope::Scope(PerfProfile* profile, unsigned section, std::uint64_t events)
+:events(events), profile(profile), section(section) {
+    if (profile != nullptr) profile->begin(section);
+}
+
+PerfProfile::Scope::~Scope(){
+    if (profile != nullptr) profile->end(section, events);
+}
@@ -0,0 +1,75 @@
+#ifndef NEUCOR_PERF_H
+#define NEUCOR_PERF_H
+
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Hardware performance counter sampling around simulation phases and benchmark bodies.
+// Uses perf_event_open on Linux. On other platforms, or when the kernel refuses the counters
+// (perf_event_paranoid, containers, missing PMU), the profile still measures wall time and
+// events, and reports the hardware counters as unavailable.
+class PerfProfile {
+    public:
+        enum counter { COUNTER_CYCLES, COUNTER_INSTRUCTIONS, COUNTER_LLC_MISSES, COUNTER_BRANCH_MISSES, COUNTER_count };
+        enum phase { PHASE_PREPARE, PHASE_DRAIN, PHASE_count };   // Sections used by NeuCor::run(). Prepare is everything before the event queue is drained
+
+        struct Section {
+            std::string name;
+            std::array<std::uint64_t, COUNTER_count> counts;     // Accumulated counter deltas
+            std::uint64_t events;                               // Simulated events attributed to this section
+            std::uint64_t calls;
+            double seconds;                                     // Accumulated wall time
+
+            std::array<std::uint64_t, COUNTER_count> startCounts;
+            std::chrono::steady_clock::time_point startTime;
+            bool running;
+        };
+
+        PerfProfile();
+        ~PerfProfile();
+        PerfProfile(const PerfProfile&) = delete;
+        PerfProfile& operator=(const PerfProfile&) = delete;
+
+        bool available() const;                                 // True if at least one hardware counter could be opened
+        bool counterAvailable(counter c) const;
+        const std::string& unavailableReason() const;           // Why the counters could not be opened (empty if they could)
+
+        unsigned addSection(const std::string& name);           // Registers a named section (e.g. a benchmark body) and returns its index
+        void begin(unsigned section);
+        void end(unsigned section, std::uint64_t events = 0);   // Accumulates counter deltas since begin() and the number of simulated events covered
+        void addEvents(unsigned section, std::uint64_t events); // Attributes events to a section after it has ended
+        void reset();                                           // Clears all accumulated values, keeps sections
+
+        const Section& getSection(unsigned section) const;
+        std::size_t getSectionCount() const;
+        void report(std::ostream& out) const;                   // Prints cycles, instructions, IPC, LLC misses and branch misses per simulated event
+
+        // Begins a section on construction and ends it on destruction.
+        class Scope {
+            public:
+                Scope(PerfProfile* profile, unsigned section, std::uint64_t events = 0);
+                ~Scope();
+                std::uint64_t events;                           // Can be updated before the scope ends
+            private:
+                PerfProfile* profile;
+                unsigned section;
+        };
+
+    private:
+        std::array<int, COUNTER_count> fds;                     // -1 if the counter is unavailable
+        int groupFd;                                            // Group leader, all available counters are read together
+        std::array<int, COUNTER_count> groupSlot;               // Position of each counter in the group read
+        unsigned groupSize;
+        std::string reason;
+        std::vector<Section> sections;
+
+        void open();
+        void close();
+        void read(std::array<std::uint64_t, COUNTER_count>& out) const; // Current (multiplex scaled) counter values
+};
+
+#endif // NEUCOR_PERF_H
@@ -0,0 +1,145 @@
+#ifndef NEUCOR_PLASTICITY_H
+#define NEUCOR_PLASTICITY_H
+
+#include "NeuCor.h"
+
+#include <cmath>
+#include <type_traits>
+
+// Plasticity rule policies (see NeuCor::setPlasticityRule()).
+// pre() returns the weight change when a spike is delivered by the synapse, post() when the target neuron fires.
+// Rules only use spike times the network keeps anyway (synapse arrivals, and the target's last and previous spikes),
+// so they add no per-synapse state. Every rule is inlined into its own pair of Synapse::presynapticPlasticity<Rule>()
+// and postsynapticPlasticity<Rule>() kernels. The network's event loop is compiled for each rule (NeuCor::drain()) and
+// calls them directly: per delivered spike, and per in-synapse from Neuron::fire<Rule>().
+// Nearest-spike traces are reset to 1 by every spike, so such a trace is exactly exp(-dt/tau) of the time since the last spike,
+// and the spike time is its whole state. Incrementally kept traces would hold the same value, at the cost of a store per spike.
+// The same holds for the triplet rule's slow postsynaptic trace, which is read just before the target's spike resets it, and so
+// only depends on the time between its previous and last spike. All-to-all traces, which sum over every earlier spike, would need state of their own.
+
+// The original rule: the presynaptic trace decays by presynapticTraceDecay per ms, the postsynaptic trace by the target type's
+// trace decay rate. Both events apply presynapticFactor*traceS - postsynapticFactor*traceT, where the trace of the event's own spike counts as 0.
+// A trace is the pair (spike time, 1), so it needs no updating between spikes; it is decayed when read (see TraceDecay).
+struct TraceRule {
+    static float change(Synapse& s){
+        NeuCor* const net = s.parentNet;
+        const Neuron* target = net->getNeuron(s.tN);
+        const tick_t now = net->getTicks();
+        // Spikes at the current tick are the event's own
+        float traceS = s.lastSpikeArrival != NeuCor::neverTick && s.lastSpikeArrival != now
+            ? net->presynapticDecay(net->presynapticTraceDecay, net->msPerTick, now - s.lastSpikeArrival) : 0.0f; // Synapse trace (presynaptic)
+        float traceT = target->lastFire != now ? target->getTrace() : 0.0f; // Target trace (postsynaptic)
+
+        return net->presynapticFactor*traceS - net->postsynapticFactor*traceT;
+    }
+    static float pre(Synapse& s){ return change(s); }
+    static float post(Synapse& s){ return change(s); }
+};
+
+// Pair-based STDP between nearest spikes: a delivered spike depresses by aMinus*exp(-dt/tauMinus) after the target's last spike,
+// a target spike potentiates by aPlus*exp(-dt/tauPlus) after the last delivered spike. A target spike at the delivery time itself
+// was caused by the delivery, and doesn't depress.
+// Multiplicative mode scales potentiation by the distance to the upper weight bound and depression by the distance to the lower
+// (soft bounds, for inhibitory synapses [-1, 0]). Additive mode relies on the hard clamp.
+template <bool multiplicative>
+struct NearestSpikeRule {
+    static float pre(Synapse& s){
+        const NeuCor::STDPParameters& p = s.parentNet->stdp;
+        const Neuron* target = s.parentNet->getNeuron(s.tN);
+        if (target->lastFire == NeuCor::neverTick || target->lastFire == s.parentNet->getTicks()) return 0.0f;
+        float change = -p.aMinus*expf(-s.parentNet->msSince(target->lastFire)/p.tauMinus);
+        if (multiplicative) change *= s.weight - (s.inhibitory ? -1.0f : 0.0f);
+        return change;
+    }
+    static float post(Synapse& s){
+        const NeuCor::STDPParameters& p = s.parentNet->stdp;
+        if (s.lastSpikeArrival == NeuCor::neverTick) return 0.0f;
+        float change = p.aPlus*expf(-s.parentNet->msSince(s.lastSpikeArrival)/p.tauPlus);
+        if (multiplicative) change *= (s.inhibitory ? 0.0f : 1.0f) - s.weight;
+        return change;
+    }
+};
+
+// Minimal triplet STDP (Pfister & Gerstner 2006) with nearest-spike traces: depression as in the pair rule (aMinus),
+// potentiation aPlus + aTriplet*exp(-dt/tauY), where dt is the time between the target's current and previous spikes.
+// Frequent target firing thus potentiates more, which pair rules can't express.
+struct TripletRule {
+    static float pre(Synapse& s){
+        return NearestSpikeRule<false>::pre(s);
+    }
+    static float post(Synapse& s){
+        const NeuCor::STDPParameters& p = s.parentNet->stdp;
+        if (s.lastSpikeArrival == NeuCor::neverTick) return 0.0f;
+        const Neuron* target = s.parentNet->getNeuron(s.tN);
+        const float slowTrace = target->previousFire == NeuCor::neverTick ? 0.0f
+            : expf(-s.parentNet->toMs(target->lastFire - target->previousFire)/p.tauY);
+        return expf(-s.parentNet->msSince(s.lastSpikeArrival)/p.tauPlus) * (p.aPlus + p.aTriplet*slowTrace);
+    }
+};
+
+// Fixed point versions of the rules (see NeuCor::setFixedPoint()). They return changes with factorBits fractional bits,
+// and compute the decays of traces and STDP windows as integer powers of the time in ticks.
+struct FixedTraceRule: FixedPoint {
+    static std::int64_t change(Synapse& s){
+        NeuCor* const net = s.parentNet;
+        const Neuron* target = net->getNeuron(s.tN);
+        const tick_t now = net->getTicks();
+        std::int64_t traceS = 0, traceT = 0;
+        if (s.lastSpikeArrival != NeuCor::neverTick && s.lastSpikeArrival != now)
+            traceS = net->fixedPresynapticDecay(net->presynapticTraceDecay, now - s.lastSpikeArrival, net->ticksPerMs);
+        if (target->lastFire != NeuCor::neverTick && target->lastFire != now)
+            traceT = net->typeTables[target->getType()].fixedTraceDecay(net->neuronTypes[target->getType()].traceDecayRate, now - target->lastFire, net->ticksPerMs);
+
+        return mul(toFixed(net->presynapticFactor, factorBits), traceS, factorBits) - mul(toFixed(net->postsynapticFactor, factorBits), traceT, factorBits);
+    }
+    static std::int64_t pre(Synapse& s){ return change(s); }
+    static std::int64_t post(Synapse& s){ return change(s); }
+};
+
+template <bool multiplicative>
+struct FixedNearestSpikeRule: FixedPoint {
+    static std::int64_t pre(Synapse& s){
+        const NeuCor::STDPParameters& p = s.parentNet->stdp;
+        const Neuron* target = s.parentNet->getNeuron(s.tN);
+        if (target->lastFire == NeuCor::neverTick || target->lastFire == s.parentNet->getTicks()) return 0;
+        std::int64_t change = -mul(toFixed(p.aMinus, factorBits), expDecay(p.tauMinus, s.parentNet->getTicks() - target->lastFire, s.parentNet->ticksPerMs), factorBits);
+        if (multiplicative) change = mul(change, toFixed(s.weight, factorBits) + (s.inhibitory ? one : 0), factorBits);
+        return change;
+    }
+    static std::int64_t post(Synapse& s){
+        const NeuCor::STDPParameters& p = s.parentNet->stdp;
+        if (s.lastSpikeArrival == NeuCor::neverTick) return 0;
+        std::int64_t change = mul(toFixed(p.aPlus, factorBits), expDecay(p.tauPlus, s.parentNet->getTicks() - s.lastSpikeArrival, s.parentNet->ticksPerMs), factorBits);
+        if (multiplicative) change = mul(change, (s.inhibitory ? 0 : one) - toFixed(s.weight, factorBits), factorBits);
+        return change;
+    }
+};
+
+struct FixedTripletRule: FixedPoint {
+    static std::int64_t pre(Synapse& s){
+        return FixedNearestSpikeRule<false>::pre(s);
+    }
+    static std::int64_t post(Synapse& s){
+        const NeuCor::STDPParameters& p = s.parentNet->stdp;
+        if (s.lastSpikeArrival == NeuCor::neverTick) return 0;
+        const Neuron* target = s.parentNet->getNeuron(s.tN);
+        const std::int64_t slowTrace = target->previousFire == NeuCor::neverTick ? 0
+            : expDecay(p.tauY, target->lastFire - target->previousFire, s.parentNet->ticksPerMs);
+        const std::int64_t amplitude = toFixed(p.aPlus, factorBits) + mul(toFixed(p.aTriplet, factorBits), slowTrace, factorBits);
+        return mul(expDecay(p.tauPlus, s.parentNet->getTicks() - s.lastSpikeArrival, s.parentNet->ticksPerMs), amplitude, factorBits);
+    }
+};
+
+template <typename Rule>
+void Synapse::presynapticPlasticity(Synapse& synapse){
+    if constexpr (std::is_base_of<FixedPoint, Rule>::value) synapse.applyFixedWeightChange(Rule::pre(synapse));
+    else synapse.applyWeightChange(Rule::pre(synapse));
+}
+
+template <typename Rule>
+void Synapse::postsynapticPlasticity(Synapse& synapse){
+    if constexpr (std::is_base_of<FixedPoint, Rule>::value) synapse.applyFixedWeightChange(Rule::post(synapse));
+    else synapse.applyWeightChange(Rule::post(synapse));
+}
+
+#endif // NEUCOR_PLASTICITY_H
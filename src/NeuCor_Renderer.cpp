@@ -261,9 +261,13 @@ NeuCor_Renderer::NeuCor_Renderer(NeuCor* _brain)
 :camPos(5,5,5), camDir(0,0,0), camUp(0,1,0), orbitFocusPoint(0,0,0), camHA(0.75), camVA(3.8), lastTime(0), deltaTime(1)
 {
     brain = _brain;
+    simulationThread = nullptr;
+    frame = &ownFrame;
     runBrainOnUpdate = true;
     paused = false;
     realRunspeed = false;
+    simulationBudget = 8.0f;
+    simulationDebt = 0.0f;
 
     navigationMode = false;
     mouseInWindow = true;
@@ -629,13 +633,26 @@ void NeuCor_Renderer::updateView(){
     FPS = (FPS*20.0+1.0/deltaTime)/21.0; // Makes FPS change slower
     float aspect = (float) width / (float)height;
 
-    if (runBrainOnUpdate && realRunspeed && !paused){
-        float staticRunSpeed = brain->runSpeed;
-        brain->runSpeed = staticRunSpeed*deltaTime;
-        brain->run();
-        brain->runSpeed = staticRunSpeed;
+    if (simulationThread){
+        simulationThread->setPaused(paused);
+        simulationThread->setRealTime(realRunspeed);
+        frame = &simulationThread->acquireFrame();
+    }
+    else if (runBrainOnUpdate && realRunspeed && !paused){
+        // Slices are as long as a 60 FPS frame's step, and at most one second of simulation is kept as debt,
+        // so slow frames neither make the steps coarser nor spiral into ever slower frames
+        simulationDebt = fmin(simulationDebt + brain->runSpeed*deltaTime, brain->runSpeed);
+        if (0.0f < simulationDebt){
+            NeuCor::RunProgress progress = brain->runFor(simulationDebt, simulationBudget, brain->runSpeed/60.0f);
+            simulationDebt = progress.remaining;
+        }
     }
     else if (runBrainOnUpdate && !paused) brain->run();
+    if (!simulationThread){
+        const tick_t previousFrame = ownFrame.ticks;
+        ownFrame.capture(*brain, ownFrame.sequence != 0 ? previousFrame : NeuCor::neverTick);
+        ownFrame.sequence++;
+    }
 
 
     frameSceneIfNeeded();
@@ -652,54 +669,55 @@ void NeuCor_Renderer::updateView(){
     if (renderMode == RENDER_ACTIVITY && evaluated != NULL) activityFunction(-1, true);
     else if (renderMode == RENDER_NOSYNAPSES) logger.synapseCount = 0;
 
-    closenessValues.resize(brain->neurons.size(), 0);
+    closenessValues.resize(frame->positions.size(), 0);
     std::vector<coord3> connections;
     std::vector<float> synPot;
-    synPot.reserve(brain->neurons.size()*8.0);
-    for (auto &neu : brain->neurons){
-        for (auto &syn : neu.outSynapses){
-            connections.push_back(brain->getNeuron(syn.pN)->position());
-            if (connections.back().x != connections.back().x){ // For debugging
-                std::cout<<"NaN coord!\n";
-            }
-            connections.push_back(brain->getNeuron(syn.tN)->position());
-            if (connections.back().x != connections.back().x){ // For debugging
-                std::cout<<"NaN coord!\n";
-            }
-            if (PRINT_CONNECTIONS_EVERY_FRAME) std::cout<<syn.pN<<" "<<connections.at(connections.size()-2).x<<" -> "<<syn.tN<<" "<<connections.back().x<<" | ";
+    connections.reserve(frame->synapseEnds.size());
+    synPot.reserve(frame->synapseEnds.size());
+    for (std::size_t i = 0; i < frame->synapseEnds.size()/2; i++){
+        const std::uint32_t pN = frame->synapseEnds[2*i], tN = frame->synapseEnds[2*i+1];
+        const float prePot = frame->synapseValues[3*i], postPot = frame->synapseValues[3*i+1], weight = frame->synapseValues[3*i+2];
+        connections.push_back(frame->positions.at(pN));
+        if (connections.back().x != connections.back().x){ // For debugging
+            std::cout<<"NaN coord!\n";
+        }
+        connections.push_back(frame->positions.at(tN));
+        if (connections.back().x != connections.back().x){ // For debugging
+            std::cout<<"NaN coord!\n";
+        }
+        if (PRINT_CONNECTIONS_EVERY_FRAME) std::cout<<pN<<" "<<connections.at(connections.size()-2).x<<" -> "<<tN<<" "<<connections.back().x<<" | ";
 
 
-            if (renderMode == RENDER_VOLTAGE){
-                synPot.push_back(syn.getPrePot()+0.03);
-                synPot.push_back(syn.getPostPot()+0.03);
+        if (renderMode == RENDER_VOLTAGE){
+            synPot.push_back(prePot+0.03);
+            synPot.push_back(postPot+0.03);
+        }
+        else if (renderMode == RENDER_PLASTICITY){
+            synPot.push_back(weight/2.0);
+            synPot.push_back(weight/2.0);
+            if (RENDER_PLASTICITY_onlyActive){
+                synPot.at(synPot.size()-2) *= log(frame->potAct.at(2*pN+1)+1.f);
+                synPot.back()              *= log(frame->potAct.at(2*tN+1)+1.f);
             }
-            else if (renderMode == RENDER_PLASTICITY){
-                synPot.push_back(syn.getWeight()/2.0);
-                synPot.push_back(syn.getWeight()/2.0);
-                if (RENDER_PLASTICITY_onlyActive){
-                    synPot.at(synPot.size()-2) *= log(brain->getNeuron(syn.pN)->activity()+1.f);
-                    synPot.back()              *= log(brain->getNeuron(syn.tN)->activity()+1.f);
-                }
 
-            }
-            else if (renderMode == RENDER_ACTIVITY && evaluated == NULL){
-                synPot.push_back(log(brain->getNeuron(syn.pN)->activity()+1.f));
-                synPot.push_back(log(brain->getNeuron(syn.tN)->activity()+1.f));
-            }
-            else if (renderMode == RENDER_ACTIVITY){
-                synPot.push_back(log(activityFunction(syn.pN)+1.f));
-                synPot.push_back(log(activityFunction(syn.tN)+1.f));
-            }
-            else if (renderMode == RENDER_CLOSENESS){
-                synPot.push_back(powf(closenessValues.at(syn.pN), closenessIntensity));
-                synPot.push_back(powf(closenessValues.at(syn.tN), closenessIntensity));
-            }
-            else if (renderMode == RENDER_NOSYNAPSES) logger.synapseCount++;
         }
+        else if (renderMode == RENDER_ACTIVITY && evaluated == NULL){
+            synPot.push_back(log(frame->potAct.at(2*pN+1)+1.f));
+            synPot.push_back(log(frame->potAct.at(2*tN+1)+1.f));
+        }
+        else if (renderMode == RENDER_ACTIVITY){
+            synPot.push_back(log(activityFunction(pN)+1.f));
+            synPot.push_back(log(activityFunction(tN)+1.f));
+        }
+        else if (renderMode == RENDER_CLOSENESS){
+            synPot.push_back(powf(closenessValues.at(pN), closenessIntensity));
+            synPot.push_back(powf(closenessValues.at(tN), closenessIntensity));
+        }
+        else if (renderMode == RENDER_NOSYNAPSES) logger.synapseCount++;
     }
     if (PRINT_CONNECTIONS_EVERY_FRAME) std::cout<<'\n';
 
-    logger.neuronCount = brain->neurons.size();
+    logger.neuronCount = frame->positions.size();
     if (renderMode != RENDER_NOSYNAPSES) logger.synapseCount = synPot.size()/2;
 
     if (renderMode == RENDER_NOSYNAPSES) goto renderNeurons; // Skip rendering synapses
@@ -770,13 +788,13 @@ void NeuCor_Renderer::updateView(){
     glUniformMatrix4fv(ViewProjMatrixID[0], 1, GL_FALSE, &vp[0][0]);
 
 
-    unsigned neuronC = brain->positions.size();
+    unsigned neuronC = frame->positions.size();
 
     glBindBuffer(GL_ARRAY_BUFFER, neuron_position_buffer);
-    glBufferData(GL_ARRAY_BUFFER, neuronC * 3 * sizeof(GLfloat), brain->positions.data(), GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, neuronC * 3 * sizeof(GLfloat), frame->positions.data(), GL_DYNAMIC_DRAW);
 
     glBindBuffer(GL_ARRAY_BUFFER, neuron_potAct_buffer);
-    glBufferData(GL_ARRAY_BUFFER, neuronC * 2 * sizeof(GLfloat), brain->potAct.data(), GL_DYNAMIC_DRAW);
+    glBufferData(GL_ARRAY_BUFFER, neuronC * 2 * sizeof(GLfloat), frame->potAct.data(), GL_DYNAMIC_DRAW);
 
     glEnableVertexAttribArray(0);
     glBindBuffer(GL_ARRAY_BUFFER, billboard_vertex_buffer);
@@ -836,6 +854,7 @@ void NeuCor_Renderer::updateView(){
 
 
 
+    std::unique_lock<std::mutex> networkLock = lockNetwork(); // The timeline and interface read the brain directly
     if (selectedNeurons.size() != 0 && !paused){
         float brainTime = brain->getTime();
         for (auto neuID: selectedNeurons) {
@@ -843,7 +862,7 @@ void NeuCor_Renderer::updateView(){
             std::deque<realTimeStats::neuronSnapshot>* neuTimeline;
             neuTimeline = &logger.timeline.at(neuID);
 
-            neuTimeline->emplace_back(realTimeStats::neuronSnapshot());
+            neuTimeline->push_back({0, 0.0f, 0.0f, realTimeStats::neuronSnapshot::weightVector(ArenaAllocator<float>(&logger.snapshotArena))});
             auto neuSnap = &neuTimeline->back();
 
             neuSnap->id = neuID;
@@ -851,6 +870,7 @@ void NeuCor_Renderer::updateView(){
             neuSnap->voltage = neu->potential();
             neuSnap->synapseWeights.reserve(neu->outSynapses.size());
             for (auto &syn: neu->outSynapses){
+                if (syn.isDeleted()) continue;
                 neuSnap->synapseWeights.push_back(syn.getWeight());
             }
 
@@ -859,6 +879,7 @@ void NeuCor_Renderer::updateView(){
         }
     }
     if (showInterface) renderInterface();
+    if (networkLock.owns_lock()) networkLock.unlock();
 
 #ifndef __EMSCRIPTEN__
     glfwSwapBuffers(window);
@@ -866,7 +887,10 @@ void NeuCor_Renderer::updateView(){
 }
 
 void NeuCor_Renderer::pollWindow(){
-    glfwPollEvents();
+    {
+        std::unique_lock<std::mutex> networkLock = lockNetwork(); // Input callbacks may change the brain
+        glfwPollEvents();
+    }
 
     int temp_width, temp_height;
 #ifdef __EMSCRIPTEN__
@@ -897,6 +921,16 @@ void NeuCor_Renderer::pollWindow(){
         }
     }
 }
+void NeuCor_Renderer::setSimulationThread(SimulationThread* thread){
+    simulationThread = thread;
+    frame = thread ? &thread->acquireFrame() : &ownFrame;
+}
+
+std::unique_lock<std::mutex> NeuCor_Renderer::lockNetwork(){
+    if (simulationThread) return simulationThread->lockNetwork();
+    return std::unique_lock<std::mutex>();
+}
+
 void NeuCor_Renderer::setDestructCallback(CallbackType callbackF){
     destructCallback = callbackF;
 }
@@ -1090,7 +1124,7 @@ void NeuCor_Renderer::updateSignalSpread(){
         int current = toCheck.back();
         toCheck.pop_back();
         for (auto &outSyn: brain->getNeuron(current)->outSynapses){
-            if (0.0 > outSyn.getWeight()) continue;
+            if (outSyn.isDeleted() || 0.0 > outSyn.getWeight()) continue;
             float newDegree = closenessValues.at(current) + 1.0/outSyn.getWeight();
             if (newDegree < closenessValues.at(outSyn.tN)){
                 toCheck.push_back(outSyn.tN);
@@ -1106,6 +1140,33 @@ void NeuCor_Renderer::updateSignalSpread(){
         neu = fmax(0, 1.0 - neu/maxDegree);
 }
 
+void NeuCor_Renderer::renumberNeurons(){
+    const std::vector<std::size_t> newIDs = brain->renumberNeurons();
+
+    for (auto &id: selectedNeurons) id = newIDs.at(id);
+
+    std::map<int, neuronWindow> windows;
+    for (auto &win: neuronWindows) windows.emplace(newIDs.at(win.first), win.second);
+    neuronWindows.swap(windows);
+
+    std::map<int, std::deque<realTimeStats::neuronSnapshot> > timeline;
+    for (auto &neuTimeline: logger.timeline){
+        for (auto &snap: neuTimeline.second) snap.id = newIDs.at(snap.id);
+        timeline.emplace(newIDs.at(neuTimeline.first), std::move(neuTimeline.second));
+    }
+    logger.timeline.swap(timeline);
+
+    for (auto &var: variables){ // Stored activities are in order of ID
+        std::vector<float>& stored = var.second.second;
+        if (stored.size() != newIDs.size()) continue;
+        std::vector<float> renumbered(stored.size());
+        for (std::size_t i = 0; i<stored.size(); i++) renumbered[newIDs[i]] = stored[i];
+        stored.swap(renumbered);
+    }
+
+    if (renderMode == RENDER_CLOSENESS) updateSignalSpread();
+}
+
 inline float NeuCor_Renderer::activityFunction(int ID, bool update){
     static std::vector<double*> variableLinks;
     static std::vector<std::vector<float>*> activityLinks;
@@ -1125,7 +1186,7 @@ inline float NeuCor_Renderer::activityFunction(int ID, bool update){
     else {
         for (int i = 0; i<variableLinks.size(); i++){
             if (i != current) *(variableLinks.at(i)) = activityLinks.at(i)->at(ID);
-            else *(variableLinks.at(i)) = brain->getNeuron(ID)->activity(); // Live update
+            else *(variableLinks.at(i)) = frame->potAct.at(2*ID+1); // Live update
         }
         return te_eval(evaluated);
     }
@@ -1250,7 +1311,7 @@ void NeuCor_Renderer::renderInterface(){
 
 
         ImColor color;
-        if (inFi.enabled) color = ImColor(0.8 - 10.0f/((float) ((float) brain->getTime()-inFi.lastFire)*10.0f+1.0f), 0.5f, 0.5f);
+        if (inFi.enabled) color = ImColor(0.8 - 10.0f/(brain->msSince(inFi.lastFire)*10.0f+1.0f), 0.5f, 0.5f);
         else color = ImColor(0.1f, 0.1f, 0.1f);
 
         glm::vec3 screenCoords = screenCoordinates(glm::vec3(inFi.a.x, inFi.a.y, inFi.a.z));
@@ -1260,7 +1321,7 @@ void NeuCor_Renderer::renderInterface(){
         glfwGetCursorPos(window, &xpos, &ypos);
         if (glm::distance(glm::vec2(screenCoords), glm::vec2(xpos, ypos)) < 10){
             ImGui::BeginTooltip();
-            ImGui::Text("Input %i: %.0f Hz", inputHandlerID, brain->inputArray[inputHandlerID]);
+            ImGui::Text("Input %i: %.0f Hz", inputHandlerID, brain->getInputRate(inputHandlerID));
             ImGui::EndTooltip();
             hoveredInput = inputHandlerID;
         }
@@ -1400,7 +1461,7 @@ void NeuCor_Renderer::renderNeuronWindow(int ID, neuronWindow* neuWin){
     }
     if (ImGui::IsItemHovered()) {ImGui::BeginTooltip(); ImGui::Text("Follow neuron"); ImGui::EndTooltip();}
     ImGui::Text("Firing frequency: %.1f Hz", neu->activity());
-    ImGui::Text("Last fire: %1.f ms ago", brain->getTime() - neu->lastFire);
+    ImGui::Text("Last fire: %1.f ms ago", brain->msSince(neu->lastFire));
 
     ImGui::Separator();
     ImGui::Text("Voltage graph");
@@ -1476,6 +1537,7 @@ void NeuCor_Renderer::renderNeuronWindow(int ID, neuronWindow* neuWin){
     ImGui::Text("Out synapses");
     int i = 0;
     for (auto &syn: neu->outSynapses){
+        if (syn.isDeleted()) continue;
         ImGui::PushID(i);
         ImGui::PushStyleColor(ImGuiCol_Header, ImColor(116, 102, 116, (int) floor(50 + syn.getPostPot()*180.0f)).Value);
         std::sprintf(buffer,"%zu", syn.tN);
@@ -1553,6 +1615,10 @@ void NeuCor_Renderer::renderModule(module* mod, bool windowed){
         ImGui::SameLine(0, 80); ImGui::Text("Synapses: %i", logger.synapseCount);
 
         ImGui::Text("Brain runtime: %.001f ms", brain->getTime());
+        const float behind = simulationThread ? simulationThread->getDebt() : simulationDebt;
+        if (realRunspeed && 0.0f < behind) {
+            ImGui::SameLine(); ImGui::TextDisabled("(%.2f ms behind)", behind);
+        }
         ImGui::Text("FPS: %i", (int) round(FPS));
         ImGui::NewLine();
         // Camera mode switcher
@@ -1718,6 +1784,17 @@ void NeuCor_Renderer::renderModule(module* mod, bool windowed){
             ImGui::PopTextWrapPos();
             ImGui::EndTooltip();
         }
+        if (!brain->runAll){
+            ImGui::Checkbox("Hybrid", &brain->hybrid);
+            ImGui::SameLine(); ImGui::TextDisabled("[?]");
+            if (ImGui::IsItemHovered()) {
+                ImGui::BeginTooltip();
+                ImGui::PushTextWrapPos(450.0f);
+                ImGui::Text("Simulates frequently firing neurons every frame, and the others only when needed. %zu neurons are currently simulated every frame.", brain->getClockDrivenCount());
+                ImGui::PopTextWrapPos();
+                ImGui::EndTooltip();
+            }
+        }
 
     } break;
 
@@ -1730,6 +1807,9 @@ void NeuCor_Renderer::renderModule(module* mod, bool windowed){
         }
         else {openTree = ImGui::CollapsingHeader("Statistics"); if (!openTree) break; activeTree = ImGui::IsItemActive();}
 
+        if (ImGui::Button("Renumber neurons spatially")) renumberNeurons();
+        if (ImGui::IsItemHovered()){ImGui::BeginTooltip(); ImGui::Text("Gives nearby neurons nearby IDs, for better memory locality"); ImGui::EndTooltip();}
+
         {
             ImGui::Text("Neuron activity distribution");
             static int a_spans = 25.0;
@@ -1800,6 +1880,7 @@ void NeuCor_Renderer::renderModule(module* mod, bool windowed){
                 if (0.0f < weightRange) {
                     for (auto &neu : brain->neurons){
                         for (auto &syn : neu.outSynapses){
+                            if (syn.isDeleted()) continue;
                             int spanIndex = floor(w_spans*((float) syn.getWeight()-w_range_min)/weightRange);
                             if (spanIndex < 0){
                                 below++;
@@ -1848,19 +1929,12 @@ void NeuCor_Renderer::renderModule(module* mod, bool windowed){
             float brainTime = brain->getTime();
             int neuronCount = brain->neurons.size();
             static std::deque<std::vector<int> > firePlot;
+            static std::uint64_t plottedFrame = 0;
             int firePlotSize = brain->runSpeed > 0.0f ? static_cast<int>(rasterPlotTime / brain->runSpeed) : 0;
 
-            if (!paused) {
-                firePlot.emplace_back();
-                firePlot.back().reserve(neuronCount/5);
-            }
-            if (!firePlot.empty()) {
-                for (auto &neu: brain->neurons) {
-                    if (brainTime - neu.lastFire < brain->runSpeed){
-                        firePlot.back().push_back(neu.getID());
-                    }
-                }
-                firePlot.back().shrink_to_fit();
+            if (!paused && plottedFrame != frame->sequence) { // A simulation thread may publish less often than the renderer draws
+                plottedFrame = frame->sequence;
+                firePlot.emplace_back(frame->spikes.begin(), frame->spikes.end());
             }
             for (int i = 0; i < (int) firePlot.size()-firePlotSize; i++)
                 firePlot.pop_front();
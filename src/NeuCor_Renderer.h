@@ -3,6 +3,7 @@
 
 /*  .h & .cpp includes  */
 #include "NeuCor.h"
+#include "NeuCor_SimulationThread.h"
 
 #include <string>
 #include <vector>
@@ -26,6 +27,7 @@ class NeuCor_Renderer {
         float getDeltaTime();
         bool runBrainOnUpdate; // If the render has the responsibility to run the brain.
         bool realRunspeed;// Makes brain's runSpeed define simulation's speed by ms/s
+        float simulationBudget; // Wall clock ms per frame that the brain may run for in real time mode. Simulation left over is caught up in later frames
         bool paused;
         bool selectNeuron(int id, bool windowOpen);
         bool deselectNeuron(int id);
@@ -42,6 +44,7 @@ class NeuCor_Renderer {
 
         void updateView();
         void pollWindow();
+        void setSimulationThread(SimulationThread* thread); // Draws the frames published by a simulation thread instead of running the brain. Not owned
 
         typedef void (*CallbackType)();
         void setDestructCallback(CallbackType f);
@@ -52,6 +55,10 @@ class NeuCor_Renderer {
     protected:
     private:
         NeuCor* brain;
+        SimulationThread* simulationThread;
+        FrameState ownFrame;                // Captured every frame when there is no simulation thread
+        const FrameState* frame;            // The frame being drawn
+        std::unique_lock<std::mutex> lockNetwork(); // Locks the brain against the simulation thread. Doesn't lock anything without one
         enum graphicsModule {MODULE_BRAIN, MODULE_TIME, MODULE_SELECTED_NEURONS, MODULE_STATS, MODULE_CONTROLS, MODULE_count};
         bool moduleInitOpen[5] = {true, true, true, false, false};
         bool dockHovered;
@@ -79,6 +86,7 @@ class NeuCor_Renderer {
         std::vector<int> selectedNeurons; // Selected neuron ID, smart pointer to bool if neuron window is open
         std::vector<float> closenessValues; float closenessIntensity;
         void updateSignalSpread();
+        void renumberNeurons();             // Renumbers the brain spatially (NeuCor::renumberNeurons()) and translates selections. Network must be locked
 
         void renderInterface();
         void renderModule(module* mod, bool windowed);
@@ -101,11 +109,13 @@ class NeuCor_Renderer {
 
             unsigned neuronCount, synapseCount;
 
+            Arena snapshotArena; // Backs the weight vectors of the timeline, which are allocated every frame
             struct neuronSnapshot { // For plotting
+                typedef std::vector<float, ArenaAllocator<float>> weightVector;
                 int id;
                 float time;
                 float voltage;
-                std::vector<float> synapseWeights;
+                weightVector synapseWeights;
             };
             std::map<int, std::deque<neuronSnapshot> > timeline;
             float maxTimeline;
@@ -150,6 +160,7 @@ class NeuCor_Renderer {
         double lastTime;
         float deltaTime;
         float FPS;
+        float simulationDebt;       // Simulated ms which real time mode is behind
         void initGLFW();
         void initOpenGL(GLFWwindow* window);
         void loadResources();
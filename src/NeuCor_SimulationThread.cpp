@@ -0,0 +1,131 @@
+#include "NeuCor_SimulationThread.h"
+
+#include <chrono>
+
+void FrameState::capture(const NeuCor& network, tick_t spikesSince){
+    time = network.getTime();
+    ticks = network.getTicks();
+    positions.assign(network.positions.begin(), network.positions.end());
+    potAct.assign(network.potAct.begin(), network.potAct.end());
+
+    synapseEnds.clear();
+    synapseValues.clear();
+    spikes.clear();
+    for (const auto &neu: network.neurons){
+        for (const auto &syn: neu.outSynapses){
+            if (syn.isDeleted()) continue;
+            synapseEnds.push_back(static_cast<std::uint32_t>(syn.pN));
+            synapseEnds.push_back(static_cast<std::uint32_t>(syn.tN));
+            synapseValues.push_back(syn.getPrePot());
+            synapseValues.push_back(syn.getPostPot());
+            synapseValues.push_back(syn.getWeight());
+        }
+        if (neu.lastFire != NeuCor::neverTick && spikesSince < neu.lastFire) spikes.push_back(static_cast<std::uint32_t>(neu.getID()));
+    }
+}
+
+SimulationThread::SimulationThread(NeuCor* network)
+:network(network), stopRequested(false), paused(false), realTime(false), waiting(0), debt(0.0f),
+middle(1), back(0), front(2), sequence(0), publishedTicks(network->getTicks()) {}
+
+SimulationThread::~SimulationThread(){
+    stop();
+}
+
+void SimulationThread::start(){
+    if (thread.joinable()) return;
+    {
+        std::unique_lock<std::mutex> lock = lockNetwork();
+        publishedTicks = network->getTicks();
+    }
+    publish(); // The renderer has a frame to draw even if the thread starts paused
+    stopRequested = false;
+    thread = std::thread(&SimulationThread::loop, this);
+}
+
+void SimulationThread::stop(){
+    if (!thread.joinable()) return;
+    stopRequested = true;
+    thread.join();
+}
+
+bool SimulationThread::running() const {
+    return thread.joinable();
+}
+
+void SimulationThread::setPaused(bool newPaused){
+    paused = newPaused;
+}
+
+void SimulationThread::setRealTime(bool newRealTime){
+    realTime = newRealTime;
+}
+
+float SimulationThread::getDebt() const {
+    return debt.load(std::memory_order_relaxed);
+}
+
+std::unique_lock<std::mutex> SimulationThread::lockNetwork(){
+    waiting.fetch_add(1);
+    std::unique_lock<std::mutex> lock(mutex);
+    waiting.fetch_sub(1);
+    return lock;
+}
+
+const FrameState& SimulationThread::acquireFrame(){
+    if (middle.load(std::memory_order_acquire) & freshBit)
+        front = middle.exchange(front, std::memory_order_acq_rel) & ~freshBit;
+    return frames[front];
+}
+
+void SimulationThread::publish(){
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        frames[back].capture(*network, publishedTicks);
+        publishedTicks = frames[back].ticks;
+    }
+    frames[back].sequence = ++sequence;
+    back = middle.exchange(back | freshBit, std::memory_order_acq_rel) & ~freshBit;
+}
+
+void SimulationThread::loop(){
+    std::chrono::steady_clock::time_point lastWall = std::chrono::steady_clock::now();
+    float simulationDebt = 0.0f;
+
+    while (!stopRequested){
+        std::chrono::steady_clock::time_point const wall = std::chrono::steady_clock::now();
+        float const elapsed = std::chrono::duration<float>(wall - lastWall).count();
+        lastWall = wall;
+
+        if (paused){
+            simulationDebt = 0.0f;
+            debt.store(0.0f, std::memory_order_relaxed);
+            std::this_thread::sleep_for(std::chrono::milliseconds(5));
+            continue;
+        }
+
+        while (waiting.load() != 0) std::this_thread::yield(); // The UI thread goes first
+
+        bool ran = false;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            float const speed = network->runSpeed;
+            if (0.0f < speed && realTime){ // Same pacing as the renderer's real time mode
+                simulationDebt = fmin(simulationDebt + speed*elapsed, speed);
+                if (0.0f < simulationDebt){
+                    simulationDebt = network->runFor(simulationDebt, sliceBudget, speed/60.0f).remaining;
+                    ran = true;
+                }
+            }
+            else if (0.0f < speed){
+                network->runFor(speed*1000.0f, sliceBudget, speed);
+                simulationDebt = 0.0f;
+                ran = true;
+            }
+        }
+        debt.store(simulationDebt, std::memory_order_relaxed);
+
+        if (ran) publish();
+        if (!ran || (realTime && simulationDebt == 0.0f)) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef NEUCOR_SIMULATIONTHREAD_H
+#define NEUCOR_SIMULATIONTHREAD_H
+
+#include "NeuCor.h"
+
+#include <atomic>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Everything the renderer draws of a network, copied at one point in simulated time.
+struct FrameState {
+    std::uint64_t sequence = 0;                         // Publication number, 0 if nothing has been captured yet
+    double time = 0.0;                                  // Simulated time (ms)
+    tick_t ticks = 0;
+    std::vector<coord3> positions;                      // Same layout as NeuCor::positions
+    std::vector<float> potAct;                          // Same layout as NeuCor::potAct
+    std::vector<std::uint32_t> synapseEnds;             // Parent and target neuron ID of every synapse
+    std::vector<float> synapseValues;                   // Pre potential, post potential and weight of every synapse
+    std::vector<std::uint32_t> spikes;                  // IDs of neurons which fired after spikesSince
+
+    void capture(const NeuCor& network, tick_t spikesSince); // Reuses the memory of the previous capture
+};
+
+// Steps a network continuously on a worker thread, decoupled from the render loop.
+// After every slice of simulation the frame state is published through three buffers, so neither
+// the simulation nor the renderer ever waits for the other to copy a frame.
+// Anything else touching the network while the thread runs (UI panels, input callbacks, presets) must hold lockNetwork().
+class SimulationThread {
+    public:
+        SimulationThread(NeuCor* network);
+        ~SimulationThread();
+        SimulationThread(const SimulationThread&) = delete;
+        SimulationThread& operator=(const SimulationThread&) = delete;
+
+        void start();
+        void stop();
+        bool running() const;
+
+        void setPaused(bool paused);
+        void setRealTime(bool realTime);    // Paces the network at runSpeed simulated ms per wall clock second, instead of running runSpeed steps as fast as possible
+        float getDebt() const;              // Simulated ms which real time pacing is behind
+
+        std::unique_lock<std::mutex> lockNetwork(); // Takes priority over the worker, which only holds the network for one runFor() call at a time
+        const FrameState& acquireFrame();   // Latest published frame, without blocking. Valid until the next call. Only one thread may acquire frames
+
+        static constexpr float sliceBudget = 4.0f; // Wall clock ms per runFor() call, i.e. the longest the worker holds the network
+
+    private:
+        NeuCor* network;
+        std::thread thread;
+        std::mutex mutex;
+        std::atomic<bool> stopRequested, paused, realTime;
+        std::atomic<unsigned> waiting;      // Threads waiting in lockNetwork()
+        std::atomic<float> debt;
+
+        FrameState frames[3];
+        static constexpr unsigned freshBit = 4;
+        std::atomic<unsigned> middle;       // Index of the last published frame, with freshBit set until it is acquired
+        unsigned back, front;               // Owned by the worker and the acquiring thread respectively
+        std::uint64_t sequence;
+        tick_t publishedTicks;
+
+        void loop();
+        void publish();                     // Captures the back frame, with the network locked, and swaps it into the middle
+};
+
+#endif // NEUCOR_SIMULATIONTHREAD_H
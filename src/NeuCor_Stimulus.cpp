@@ -0,0 +1,80 @@
+#include "NeuCor_Stimulus.h"
+
+StimulusQueue::StimulusQueue(std::size_t capacity)
+:enqueuePosition(0), dequeuePosition(0) {
+    std::size_t size = 2;
+    while (size < capacity) size <<= 1;
+    cells.reset(new Cell[size]);
+    mask = size - 1;
+    for (std::size_t i = 0; i<size; i++) cells[i].sequence.store(i, std::memory_order_relaxed);
+}
+
+bool StimulusQueue::push(const Stimulus& stimulus){
+    std::size_t position = enqueuePosition.load(std::memory_order_relaxed);
+    Cell* cell;
+    while (true){
+        cell = &cells[position & mask];
+        const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+        const std::intptr_t difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+        if (difference == 0){ // The cell is free; claim it unless another producer got there first
+            if (enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed)) break;
+        }
+        else if (difference < 0) return false; // The consumer hasn't freed the cell yet, i.e. the queue is full
+        else position = enqueuePosition.load(std::memory_order_relaxed);
+    }
+    cell->stimulus = stimulus;
+    cell->sequence.store(position + 1, std::memory_order_release);
+    return true;
+}
+
+bool StimulusQueue::pop(Stimulus& stimulus){
+    Cell* cell = &cells[dequeuePosition & mask];
+    const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+    if (static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(dequeuePosition + 1) < 0) return false;
+
+    stimulus = cell->stimulus;
+    cell->sequence.store(dequeuePosition + mask + 1, std::memory_order_release);
+    dequeuePosition++;
+    return true;
+}
+
+std::size_t StimulusQueue::capacity() const {
+    return mask + 1;
+}
+
+StimulusInjector::StimulusInjector(NeuCor* p)
+:simulator(p), arrivals(0) {}
+
+void StimulusInjector::add(const Stimulus& stimulus){
+    pending.push({stimulus, arrivals++});
+    parentNet->queueSimulationAt(this, stimulus.time);
+}
+
+void StimulusInjector::renumber(const std::vector<std::size_t>& newIDs){
+    std::vector<pendingStimulus> stimuli;
+    stimuli.reserve(pending.size());
+    for (; !pending.empty(); pending.pop()) stimuli.push_back(pending.top());
+    for (auto &p: stimuli){
+        if (p.stimulus.type != Stimulus::STIMULUS_INPUT_RATE && p.stimulus.target < newIDs.size())
+            p.stimulus.target = static_cast<std::uint32_t>(newIDs[p.stimulus.target]);
+        pending.push(p);
+    }
+}
+
+void StimulusInjector::run(){
+    const tick_t now = parentNet->getTicks();
+    while (!pending.empty() && pending.top().stimulus.time <= now){
+        const Stimulus stimulus = pending.top().stimulus;
+        pending.pop();
+        if (parentNet->neurons.size() <= stimulus.target) continue;
+
+        Neuron* neu = parentNet->getNeuron(stimulus.target);
+        if (neu->isDeleted()) continue;
+        if (stimulus.type == Stimulus::STIMULUS_SPIKE) neu->fire();
+        else if (stimulus.type == Stimulus::STIMULUS_CURRENT){
+            neu->run();
+            neu->givePotential(stimulus.value);
+            parentNet->queueSimulationAt(neu, now + 1); // Threshold check, once time has passed
+        }
+    }
+}
@@ -0,0 +1,69 @@
+#ifndef NEUCOR_STIMULUS_H
+#define NEUCOR_STIMULUS_H
+
+#include "NeuCor.h"
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <queue>
+#include <vector>
+
+// Timed event injected into a running network from another thread (see NeuCor::enableStimuli())
+struct Stimulus {
+    enum stimulusType : std::uint8_t {
+        STIMULUS_SPIKE,                                 // Fires the target neuron
+        STIMULUS_CURRENT,                               // Adds value (mV) to the target neuron's potential
+        STIMULUS_INPUT_RATE                             // Sets the rate of input target to value (Hz)
+    };
+    tick_t time;
+    float value;
+    std::uint32_t target;                               // Neuron ID, or input ID for STIMULUS_INPUT_RATE
+    stimulusType type;
+};
+
+// Bounded lock-free multi-producer single-consumer queue (Dmitry Vyukov's bounded queue).
+// Any thread may push; only the thread running the network pops. Neither side ever blocks or allocates.
+class StimulusQueue {
+    public:
+        StimulusQueue(std::size_t capacity);            // Rounded up to a power of two
+        StimulusQueue(const StimulusQueue&) = delete;
+        StimulusQueue& operator=(const StimulusQueue&) = delete;
+
+        bool push(const Stimulus& stimulus);            // False if the queue is full
+        bool pop(Stimulus& stimulus);                   // False if the queue is empty. Consumer only
+        std::size_t capacity() const;
+
+    private:
+        struct Cell {
+            std::atomic<std::size_t> sequence;
+            Stimulus stimulus;
+        };
+        std::unique_ptr<Cell[]> cells;
+        std::size_t mask;
+        alignas(64) std::atomic<std::size_t> enqueuePosition;
+        alignas(64) std::size_t dequeuePosition;
+};
+
+// Applies drained spike and current stimuli at their simulated time, in time order
+struct StimulusInjector: public simulator {
+    StimulusInjector(NeuCor* p);
+    void add(const Stimulus& stimulus);                 // Schedules a stimulus, which must not be in the past
+    void run() override;                                // Applies all stimuli due at the current time
+    void renumber(const std::vector<std::size_t>& newIDs); // Translates the neuron targets of pending stimuli (see NeuCor::renumberNeurons())
+
+    private:
+        struct pendingStimulus {
+            Stimulus stimulus;
+            std::uint64_t arrival;                      // Tie breaker, so that same-time stimuli are applied in arrival order
+            bool operator>(const pendingStimulus& other) const {
+                if (stimulus.time != other.stimulus.time) return stimulus.time > other.stimulus.time;
+                return arrival > other.arrival;
+            }
+        };
+        std::priority_queue<pendingStimulus, std::vector<pendingStimulus>, std::greater<pendingStimulus>> pending;
+        std::uint64_t arrivals;
+};
+
+#endif // NEUCOR_STIMULUS_H
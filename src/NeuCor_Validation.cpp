@@ -0,0 +1,255 @@
+#include "NeuCor_Validation.h"
+#include "NeuCor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iomanip>
+#include <memory>
+#include <stdlib.h>
+
+namespace {
+std::vector<std::vector<float>> spikeTrains(const NeuCor_Validator::Record& record){
+    std::vector<std::vector<float>> trains(record.neuronCount);
+    for (const auto &spike: record.spikes){
+        if (spike.second < trains.size()) trains[spike.second].push_back(spike.first);
+    }
+    for (auto &train: trains) std::sort(train.begin(), train.end());
+    return trains;
+}
+
+// Pearson correlations of binned spike counts, for all pairs of the given neurons
+std::vector<double> pairCorrelations(const std::vector<std::vector<float>>& trains, const std::vector<std::size_t>& selection, float duration, float binSize){
+    const std::size_t bins = std::max<std::size_t>(1, static_cast<std::size_t>(std::ceil(duration/binSize)));
+    std::vector<std::vector<double>> counts(selection.size(), std::vector<double>(bins, 0.0));
+    for (std::size_t s = 0; s<selection.size(); s++){
+        for (float t: trains.at(selection[s])) counts[s][std::min(bins-1, static_cast<std::size_t>(std::max(0.0f, t)/binSize))] += 1.0;
+    }
+
+    std::vector<double> means(selection.size(), 0.0), deviations(selection.size(), 0.0);
+    for (std::size_t s = 0; s<selection.size(); s++){
+        for (double c: counts[s]) means[s] += c;
+        means[s] /= bins;
+        for (double c: counts[s]) deviations[s] += (c-means[s])*(c-means[s]);
+        deviations[s] = std::sqrt(deviations[s]);
+    }
+
+    std::vector<double> correlations;
+    for (std::size_t i = 0; i<selection.size(); i++){
+        for (std::size_t j = i+1; j<selection.size(); j++){
+            double covariance = 0.0;
+            for (std::size_t b = 0; b<bins; b++) covariance += (counts[i][b]-means[i])*(counts[j][b]-means[j]);
+            const double norm = deviations[i]*deviations[j];
+            correlations.push_back(norm != 0.0 ? covariance/norm : 0.0);
+        }
+    }
+    return correlations;
+}
+
+// Summary statistics of one run, which are compared between variants
+std::vector<double> summarise(const NeuCor_Validator::Record& record, const NeuCor_Validator::Options& options){
+    const std::vector<std::vector<float>> trains = spikeTrains(record);
+
+    std::vector<float> intervals;
+    for (const auto &train: trains) for (std::size_t s = 1; s<train.size(); s++) intervals.push_back(train[s]-train[s-1]);
+    std::sort(intervals.begin(), intervals.end());
+    const double medianInterval = intervals.empty() ? record.duration : intervals[intervals.size()/2];
+
+    std::vector<std::size_t> selection(trains.size());
+    for (std::size_t i = 0; i<trains.size(); i++) selection[i] = i;
+    std::sort(selection.begin(), selection.end(), [&trains](std::size_t x, std::size_t y){
+        return trains[x].size() != trains[y].size() ? trains[x].size() > trains[y].size() : x < y;
+    });
+    selection.resize(std::min<std::size_t>(selection.size(), options.correlationNeurons));
+    const std::vector<double> correlations = pairCorrelations(trains, selection, record.duration, options.binSize);
+    double correlation = 0.0;
+    for (double c: correlations) correlation += c;
+    if (!correlations.empty()) correlation /= correlations.size();
+
+    double weightMean = 0.0, weightSpread = 0.0;
+    for (float w: record.finalWeights) weightMean += w;
+    if (!record.finalWeights.empty()) weightMean /= record.finalWeights.size();
+    for (float w: record.finalWeights) weightSpread += (w-weightMean)*(w-weightMean);
+    if (!record.finalWeights.empty()) weightSpread = std::sqrt(weightSpread/record.finalWeights.size());
+
+    const double rate = record.neuronCount == 0 ? 0.0 : record.spikes.size()/(record.neuronCount*record.duration/1000.0);
+    return {rate, medianInterval, correlation, weightMean, weightSpread};
+}
+const char* const statisticNames[] = {"Mean rate (Hz)", "Median ISI (ms)", "Spike correlation", "Mean weight", "Weight spread"};
+
+void meanAndSpread(const std::vector<double>& values, double& mean, double& spread){
+    mean = 0.0, spread = 0.0;
+    for (double v: values) mean += v;
+    if (!values.empty()) mean /= values.size();
+    for (double v: values) spread += (v-mean)*(v-mean);
+    spread = values.size() < 2 ? 0.0 : std::sqrt(spread/(values.size()-1));
+}
+
+std::uint64_t fnv1a(std::uint64_t hash, const void* data, std::size_t size){
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    for (std::size_t i = 0; i<size; i++){
+        hash ^= bytes[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+}
+
+const std::vector<NeuCor_Validator::EngineVariant>& NeuCor_Validator::variants(){
+    static const std::vector<EngineVariant> all = {
+        {"event", "Event driven: only neurons with pending events are updated", [](NeuCor& n){ n.runAll = false; }, false},
+        {"runAll", "Clock driven: every neuron is updated at every step", [](NeuCor& n){ n.runAll = true; }, false},
+        {"deterministic", "Event driven, deterministic mode (total event order, network RNG)", [](NeuCor& n){ n.runAll = false; }, true},
+        {"deterministicRunAll", "Clock driven, deterministic mode", [](NeuCor& n){ n.runAll = true; }, true},
+        {"hybrid", "Hybrid: frequently firing neurons clock driven, the rest event driven", [](NeuCor& n){ n.runAll = false; n.hybrid = true; }, false},
+        {"deterministicHybrid", "Hybrid, deterministic mode", [](NeuCor& n){ n.runAll = false; n.hybrid = true; }, true},
+        {"fixedPoint", "Event driven, fixed point kernels", [](NeuCor& n){ n.runAll = false; n.setFixedPoint(true); }, false},
+        {"deterministicFixedPoint", "Event driven, fixed point kernels, deterministic mode", [](NeuCor& n){ n.runAll = false; n.setFixedPoint(true); }, true},
+        {"silentControl", "Control: event driven, but thresholds are out of reach, so only inputs fire neurons", [](NeuCor& n){
+            n.runAll = false;
+            for (unsigned type = 0; type<n.getNeuronTypeCount(); type++){
+                NeuronType parameters = n.getNeuronType(type);
+                parameters.threshold = 1000.0f;
+                n.setNeuronType(type, parameters);
+            }
+        }, false},
+        {"frozenWeightsControl", "Control: event driven, without plasticity", [](NeuCor& n){ n.runAll = false; n.learningRate = 0.0f; }, false},
+    };
+    return all;
+}
+
+const NeuCor_Validator::EngineVariant* NeuCor_Validator::findVariant(const std::string& name){
+    for (const auto &variant: variants()){
+        if (variant.name == name) return &variant;
+    }
+    return nullptr;
+}
+
+std::uint64_t NeuCor_Validator::digest(const NeuCor& network){
+    std::uint64_t hash = 14695981039346656037ull;
+    const tick_t time = network.getTicks();
+    hash = fnv1a(hash, &time, sizeof(time));
+    hash = fnv1a(hash, network.potAct.data(), network.potAct.size()*sizeof(float));
+    for (const auto &neuron: network.neurons){
+        for (const auto &synapse: neuron.outSynapses){
+            if (synapse.isDeleted()) continue;
+            const float weight = synapse.getWeight();
+            hash = fnv1a(hash, &weight, sizeof(weight));
+        }
+    }
+    return hash;
+}
+
+NeuCor_Validator::Record NeuCor_Validator::record(const EngineVariant& variant, const Options& options){
+    srand(options.seed); // Both variants get the same network, input positions and random stream
+
+    std::unique_ptr<NeuCor> constructed(variant.deterministic ? new NeuCor(options.neurons, options.seed) : new NeuCor(options.neurons));
+    NeuCor& network = *constructed;
+    if (variant.configure) variant.configure(network);
+    if (options.streamSeed != 0){
+        srand(options.streamSeed);
+        network.rngState = options.streamSeed;
+    }
+    network.runSpeed = options.step;
+
+    std::vector<float> rates = options.inputRates;
+    network.setInputRateArray(rates.data(), rates.size());
+
+    Record result;
+    result.variant = variant.name;
+    result.neuronCount = network.neurons.size();
+    result.duration = options.duration;
+
+    // Every spike, including several of one neuron within a step, is delivered at the end of the step
+    network.addSpikeObserver([&result](const NeuCor::SpikeEvent* spikes, std::size_t count){
+        for (std::size_t s = 0; s<count; s++) result.spikes.emplace_back(float(spikes[s].time), static_cast<std::uint32_t>(spikes[s].id));
+    });
+    while (network.getTime() < options.duration){
+        network.run();
+        result.stepTimes.push_back(network.getTime());
+        result.stepDigests.push_back(digest(network));
+    }
+
+    for (const auto &neuron: network.neurons){
+        for (const auto &synapse: neuron.outSynapses)
+            if (!synapse.isDeleted()) result.finalWeights.push_back(synapse.getWeight());
+    }
+    return result;
+}
+
+std::vector<NeuCor_Validator::Record> NeuCor_Validator::recordSeeds(const EngineVariant& variant, const Options& options){
+    std::vector<Record> records;
+    Options seedOptions = options;
+    for (unsigned s = 0; s<options.seeds; s++){
+        seedOptions.seed = options.seed + s;
+        records.push_back(record(variant, seedOptions));
+    }
+    return records;
+}
+
+NeuCor_Validator::Report NeuCor_Validator::compare(const std::vector<Record>& a, const std::vector<Record>& b, const Options& options){
+    Report report;
+    report.seeds = std::min(a.size(), b.size());
+    report.exact = options.exact;
+    report.spikesA = 0, report.spikesB = 0;
+    for (const Record& r: a) report.spikesA += r.spikes.size();
+    for (const Record& r: b) report.spikesB += r.spikes.size();
+
+    // Summary statistics, each compared by the difference of its seed means against the standard error of that difference
+    std::vector<std::vector<double>> valuesA(5), valuesB(5);
+    for (std::size_t s = 0; s<report.seeds; s++){
+        const std::vector<double> summaryA = summarise(a[s], options), summaryB = summarise(b[s], options);
+        for (std::size_t i = 0; i<summaryA.size(); i++) valuesA[i].push_back(summaryA[i]), valuesB[i].push_back(summaryB[i]);
+    }
+    for (std::size_t i = 0; i<valuesA.size(); i++){
+        Statistic statistic;
+        statistic.name = statisticNames[i];
+        meanAndSpread(valuesA[i], statistic.meanA, statistic.spreadA);
+        meanAndSpread(valuesB[i], statistic.meanB, statistic.spreadB);
+        const double difference = std::abs(statistic.meanA - statistic.meanB);
+        const double standardError = report.seeds == 0 ? 0.0 :
+            std::sqrt((statistic.spreadA*statistic.spreadA + statistic.spreadB*statistic.spreadB)/report.seeds);
+        statistic.score = difference == 0.0 ? 0.0 : standardError == 0.0 ? INFINITY : difference/standardError;
+        statistic.passed = statistic.score <= options.tolerance;
+        report.statistics.push_back(statistic);
+    }
+
+    // Bitwise divergence
+    report.identicalSeeds = 0;
+    report.divergenceTime = NAN;
+    for (std::size_t s = 0; s<report.seeds; s++){
+        const std::size_t steps = std::min(a[s].stepDigests.size(), b[s].stepDigests.size());
+        float divergence = NAN;
+        for (std::size_t step = 0; step<steps; step++){
+            if (a[s].stepDigests[step] != b[s].stepDigests[step] || a[s].stepTimes[step] != b[s].stepTimes[step]){
+                divergence = a[s].stepTimes[step];
+                break;
+            }
+        }
+        if (divergence == divergence) report.divergenceTime = report.divergenceTime == report.divergenceTime ? std::min(report.divergenceTime, divergence) : divergence;
+        else if (a[s].stepDigests.size() == b[s].stepDigests.size() && a[s].spikes == b[s].spikes) report.identicalSeeds++;
+    }
+    return report;
+}
+
+bool NeuCor_Validator::Report::passed() const {
+    if (exact) return seeds != 0 && identicalSeeds == seeds;
+    for (const Statistic& statistic: statistics)
+        if (!statistic.passed) return false;
+    return true;
+}
+
+void NeuCor_Validator::Report::print(std::ostream& out) const {
+    const auto verdict = [](bool ok){ return ok ? "ok" : "FAIL"; };
+    out<<std::fixed<<std::setprecision(4);
+    out<<"Spikes:                 "<<spikesA<<" vs "<<spikesB<<" over "<<seeds<<" seeds\n";
+    for (const Statistic& statistic: statistics){
+        out<<std::left<<std::setw(24)<<(statistic.name + ":")<<std::right<<statistic.meanA<<" (sd "<<statistic.spreadA<<") vs "
+           <<statistic.meanB<<" (sd "<<statistic.spreadB<<"), "<<std::setprecision(1)<<statistic.score<<" standard errors";
+        out<<std::setprecision(4)<<(exact ? "\n" : std::string("  [") + verdict(statistic.passed) + "]\n");
+    }
+    out<<"Bitwise identical for "<<identicalSeeds<<" of "<<seeds<<" seeds";
+    if (divergenceTime == divergenceTime) out<<", earliest divergence at "<<divergenceTime<<" ms";
+    out<<(exact ? std::string("  [") + verdict(passed()) + "]\n" : "\n");
+    out<<(passed() ? "PASSED" : "FAILED")<<'\n';
+    out<<std::defaultfloat;
+}
@@ -0,0 +1,84 @@
+#ifndef NEUCOR_VALIDATION_H
+#define NEUCOR_VALIDATION_H
+
+#include <cstdint>
+#include <functional>
+#include <ostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+class NeuCor;
+
+// Differential validation of engine variants.
+// Two engine configurations are run from the same seeds and networks. The network is chaotic, so single runs of two correct
+// variants differ a lot. Instead, summary statistics of the spike rasters and final weights are averaged over several seeds,
+// and the means of the two variants are compared against their seed-to-seed spread. Runs are also fingerprinted at every step,
+// which gives the simulated time where two deterministic variants stop being bitwise identical.
+class NeuCor_Validator {
+    public:
+        struct EngineVariant {
+            std::string name;
+            std::string description;
+            std::function<void(NeuCor&)> configure;     // Applied to the freshly constructed network, before inputs are set
+            bool deterministic;                         // Constructs the network in deterministic mode from the seed
+        };
+        static const std::vector<EngineVariant>& variants(); // All known engine variants, and controls which must fail validation
+        static const EngineVariant* findVariant(const std::string& name);
+
+        struct Options {
+            unsigned seed = 1;                          // First seed. Every variant is run once for each of the seeds seed, seed+1, ...
+            unsigned seeds = 8;
+            unsigned streamSeed = 0;                    // Reseeds the random stream after the network is constructed, 0 keeps the seed's stream
+            int neurons = 300;
+            float duration = 1000.0f;                   // Simulated ms
+            float step = 1.0f;                          // runSpeed used for every run() call
+
+            float binSize = 5.0f;                       // ms, for spike count correlations
+            unsigned correlationNeurons = 40;           // Number of most active neurons included in the correlation statistic
+            std::vector<float> inputRates = {40.0f, 40.0f, 25.0f};
+
+            // Largest accepted difference between the seed means of a statistic, in standard errors of that difference
+            // (from the seed-to-seed standard deviations of both variants). Equivalent variants fail well under 1% of the time
+            float tolerance = 4.0f;
+            bool exact = false;                         // Instead, the runs must be bitwise identical for every seed. For deterministic variants
+        };
+
+        struct Record {
+            std::string variant;
+            std::size_t neuronCount;
+            float duration;
+            std::vector<std::pair<float, std::uint32_t>> spikes; // (time, neuron ID) in order of recording
+            std::vector<float> stepTimes;               // Simulated time at the end of every step
+            std::vector<std::uint64_t> stepDigests;     // Hash of time, potentials, activities and weights at the end of every step
+            std::vector<float> finalWeights;
+        };
+
+        struct Statistic {
+            std::string name;
+            double meanA, meanB;                        // Means over the seeds
+            double spreadA, spreadB;                    // Seed-to-seed standard deviations
+            double score;                               // Difference of the means, in standard errors
+            bool passed;
+        };
+
+        struct Report {
+            std::vector<Statistic> statistics;
+            std::size_t spikesA, spikesB;               // Over all seeds
+            unsigned seeds, identicalSeeds;             // Seeds for which the runs are bitwise identical
+            float divergenceTime;                       // Earliest step end time where the fingerprints differ, NAN if they never do
+            bool exact;
+
+            bool passed() const;
+            void print(std::ostream& out) const;
+        };
+
+        static Record record(const EngineVariant& variant, const Options& options); // One run, from options.seed
+        static std::vector<Record> recordSeeds(const EngineVariant& variant, const Options& options); // One run for each seed
+        static Report compare(const std::vector<Record>& a, const std::vector<Record>& b, const Options& options); // Runs of the same seeds
+
+    private:
+        static std::uint64_t digest(const NeuCor& network);
+};
+
+#endif // NEUCOR_VALIDATION_H
@@ -0,0 +1,51 @@
+#ifndef NEUCOR_WAVEFORMS_H
+#define NEUCOR_WAVEFORMS_H
+
+#include <cstddef>
+
+// e^x, usable in constant expressions (std::exp isn't constexpr). Taylor series of x/2^n, squared n times.
+// Accurate to float precision for the moderate arguments of waveform shapes.
+constexpr double constexprExp(double x){
+    int halvings = 0;
+    while (0.5 < x || x < -0.5){
+        x /= 2.0;
+        halvings++;
+    }
+    double sum = 1.0, term = 1.0;
+    for (int i = 1; i<16; i++){
+        term *= x/i;
+        sum += term;
+    }
+    while (halvings--) sum *= sum;
+    return sum;
+}
+
+// A curve sampled at N+1 evenly spaced points of [origin, origin + N/scale], and linearly interpolated in between.
+// Arguments outside the range are clamped to it. Evaluation is two loads and a multiply-add, with no transcendental calls.
+template <std::size_t N>
+struct Waveform {
+    static constexpr std::size_t size = N;
+    float origin = 0.0f;
+    float scale = 0.0f;                  // Samples per unit of the argument
+    float samples[N+1] = {};
+
+    float operator()(float x) const {
+        float position = (x - origin)*scale;
+        if (!(0.0f < position)) return samples[0]; // Also NAN arguments
+        if (float(N) <= position) return samples[N];
+        std::size_t const i = static_cast<std::size_t>(position);
+        return samples[i] + (samples[i+1] - samples[i])*(position - float(i));
+    }
+};
+
+// Samples f (double -> double) over [start, end]
+template <std::size_t N, typename F>
+constexpr Waveform<N> sampleWaveform(F f, float start, float end){
+    Waveform<N> waveform;
+    waveform.origin = start;
+    waveform.scale = float(N)/(end - start);
+    for (std::size_t i = 0; i<=N; i++) waveform.samples[i] = static_cast<float>(f(start + (double(end) - start)*i/N));
+    return waveform;
+}
+
+#endif // NEUCOR_WAVEFORMS_H
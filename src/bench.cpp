@@ -0,0 +1,203 @@
+#include "NeuCor.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdio.h>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+// Microbenchmarks of simulation core design choices. Each prints its measurements, so that they can be recorded in the README.
+
+namespace {
+void showUsage(){
+    printf("Neuro Correlation benchmark usage: [--help] [--ticks-per-ms <ticks>] [--events <count>] [--neurons <count>] [--threads <count>] <benchmark>\n"
+           "The following are the benchmarks:\n"
+           "\ttrace - evaluating spike traces: TraceDecay's per-delay table against exp2 of the delay, and against incrementally stored traces\n"
+           "\tbuild - bulk construction of a seeded network of --neurons neurons (1000000 by default, which needs about 9 GB), on one thread\n"
+           "\t        and on --threads threads (0, the default, for every hardware thread)\n");
+}
+
+struct Options {
+    std::int64_t ticksPerMs = 1000;
+    std::size_t events = 20000000;
+    int neurons = 1000000;
+    unsigned threads = 0;
+};
+
+std::uint64_t nextRandom(std::uint64_t& state){ // splitmix64
+    std::uint64_t z = (state += 0x9e3779b97f4a7c15ull);
+    z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+    z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+    return z ^ (z >> 31);
+}
+
+// One trace evaluation per event, as the trace rule does when a synapse delivers a spike: the synapse's trace is read,
+// then reset by the spike. Synapses are picked at random, and time advances so that the mean delay since a synapse's
+// last spike is meanDelay ms. Each variant returns the sum of the traces it read, and the sum for the variants to match.
+struct TraceBenchmark {
+    static constexpr std::size_t synapses = 1 << 18;
+    static constexpr float rate = 0.75f;                    // NeuCor::presynapticTraceDecay
+    static constexpr double meanDelay = 20.0;               // ms
+
+    std::int64_t ticksPerMs;
+    double msPerTick;
+    std::vector<std::uint32_t> picks;                       // Synapse of each event
+    std::vector<tick_t> times;                              // Time of each event
+
+    TraceBenchmark(const Options& options): ticksPerMs(options.ticksPerMs), msPerTick(1.0/double(options.ticksPerMs)){
+        std::uint64_t state = 1;
+        const double ticksPerEvent = meanDelay*double(ticksPerMs)/double(synapses);
+        double time = 0.0;
+        picks.resize(options.events), times.resize(options.events);
+        for (std::size_t i = 0; i<options.events; i++){
+            picks[i] = static_cast<std::uint32_t>(nextRandom(state) % synapses);
+            time += ticksPerEvent * 2.0 * double(nextRandom(state) >> 11) / double(1ull << 53);
+            times[i] = static_cast<tick_t>(time);
+        }
+    }
+
+    // The engine: spike times only, decayed when read with TraceDecay, which looks the delay up in its table
+    double traceDecay() const {
+        std::vector<tick_t> lastSpike(synapses, NeuCor::neverTick);
+        TraceDecay decay;
+        double sum = 0.0;
+        for (std::size_t i = 0; i<picks.size(); i++){
+            tick_t& last = lastSpike[picks[i]];
+            if (last != NeuCor::neverTick && last != times[i]) sum += decay(rate, msPerTick, times[i] - last);
+            last = times[i];
+        }
+        return sum;
+    }
+
+    // Spike times only, decayed when read as exp2 of a precomputed log2 factor per tick
+    double exp2PerTick() const {
+        const double log2PerTick = std::log2(double(rate))*msPerTick;
+        std::vector<tick_t> lastSpike(synapses, NeuCor::neverTick);
+        double sum = 0.0;
+        for (std::size_t i = 0; i<picks.size(); i++){
+            tick_t& last = lastSpike[picks[i]];
+            if (last != NeuCor::neverTick && last != times[i]) sum += exp2f(static_cast<float>(log2PerTick*double(times[i] - last)));
+            last = times[i];
+        }
+        return sum;
+    }
+
+    // Traces stored as (last update time, value) and updated at every spike, decayed with TraceDecay
+    double incremental() const {
+        struct Trace {
+            tick_t updated;
+            float value;
+        };
+        std::vector<Trace> traces(synapses, Trace{0, 0.0f});
+        TraceDecay decay;
+        double sum = 0.0;
+        for (std::size_t i = 0; i<picks.size(); i++){
+            Trace& trace = traces[picks[i]];
+            const tick_t delay = times[i] - trace.updated;
+            if (delay != 0) sum += trace.value*decay(rate, msPerTick, delay);
+            trace.updated = times[i], trace.value = 1.0f;
+        }
+        return sum;
+    }
+
+    double reference() const {
+        std::vector<tick_t> lastSpike(synapses, NeuCor::neverTick);
+        double sum = 0.0;
+        for (std::size_t i = 0; i<picks.size(); i++){
+            tick_t& last = lastSpike[picks[i]];
+            if (last != NeuCor::neverTick && last != times[i]) sum += std::pow(double(rate), double(times[i] - last)*msPerTick);
+            last = times[i];
+        }
+        return sum;
+    }
+};
+
+template <typename Function>
+void measure(const char* name, std::size_t events, double reference, Function function){
+    const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    const double sum = function();
+    const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("\t%-16s %6.2f ns/event, relative error of the trace sum %.1e\n", name, seconds*1e9/double(events), std::abs(sum - reference)/reference);
+}
+
+// Resident set size in bytes, 0 if unknown
+std::uint64_t residentMemory(){
+#ifdef __linux__
+    std::ifstream statm("/proc/self/statm");
+    std::uint64_t size = 0, resident = 0;
+    if (statm>>size>>resident) return resident*static_cast<std::uint64_t>(sysconf(_SC_PAGESIZE));
+#endif
+    return 0;
+}
+
+// NeuCor(neurons, seed, threads), which places the neurons, finds their neighbours and builds their synapses in parallel chunks.
+// The network doesn't depend on the thread count, so the runs only differ in time
+void buildBenchmark(const Options& options){
+    const unsigned threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+    printf("Bulk construction of %d neurons\n", options.neurons);
+    for (unsigned runThreads: {1u, threads}){
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        NeuCor network(options.neurons, 1, runThreads);
+        const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        printf("\t%2u threads %8.2f s, %llu synapses, %.0f MB resident\n", runThreads, seconds,
+               static_cast<unsigned long long>(network.getCounters().synapses.load()), double(residentMemory())/(1024.0*1024.0));
+        if (runThreads == threads) break;
+    }
+}
+
+void traceBenchmark(const Options& options){
+    const TraceBenchmark benchmark(options);
+    const double reference = benchmark.reference();
+    printf("Trace evaluation, %zu events on %zu synapses, %lld ticks per ms\n", options.events,
+           TraceBenchmark::synapses, static_cast<long long>(options.ticksPerMs));
+    for (int repeat = 0; repeat<5; repeat++){
+        measure("TraceDecay", options.events, reference, [&]{ return benchmark.traceDecay(); });
+        measure("exp2 per tick", options.events, reference, [&]{ return benchmark.exp2PerTick(); });
+        measure("incremental", options.events, reference, [&]{ return benchmark.incremental(); });
+    }
+}
+}
+
+int main(int argc, char* argv[]){
+    Options options;
+    std::string benchmark;
+
+    // Interpret arguments
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if (arg == "--help") {
+            showUsage();
+            return 0;
+        }
+        else if (arg.rfind("--", 0) == 0){
+            if (i+1 == argc){
+                fprintf(stderr, "Missing %s value\n", arg.c_str());
+                return 1;
+            }
+            std::string value = argv[++i];
+            if (arg == "--ticks-per-ms") options.ticksPerMs = std::stoll(value, nullptr, 0);
+            else if (arg == "--events") options.events = std::stoul(value, nullptr, 0);
+            else if (arg == "--neurons") options.neurons = std::stoi(value, nullptr, 0);
+            else if (arg == "--threads") options.threads = std::stoul(value, nullptr, 0);
+            else {
+                fprintf(stderr, "Unknown option %s\n", arg.c_str());
+                return 1;
+            }
+        }
+        else benchmark = arg;
+    }
+
+    if (benchmark == "trace" && 0 < options.ticksPerMs && 0 < options.events) traceBenchmark(options);
+    else if (benchmark == "build" && 0 <= options.neurons) buildBenchmark(options);
+    else {
+        showUsage();
+        return 1;
+    }
+    return 0;
+}
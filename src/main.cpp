@@ -1,5 +1,9 @@
 #include "NeuCor.h"
 #include "NeuCor_Renderer.h"
+#include "NeuCor_Perf.h"
+#include "NeuCor_Metrics.h"
+#include "NeuCor_FlightRecorder.h"
+#include "NeuCor_SimulationThread.h"
 
 #include <algorithm>
 #include <exception>
@@ -16,6 +20,23 @@
 
 
 bool windowDestroyed = false;
+bool perfCounters = false;
+bool simulationThread = false;
+bool hybridScheduling = false;
+bool fixedPoint = false;
+bool deterministic = false;
+unsigned seed = 0;
+int buildThreads = -1;                // Threads of the bulk network construction (0 for all), -1 builds networks serially
+long timeResolution = 0;              // Ticks per ms, 0 keeps the network's default
+NeuCor::neuronModels neuronModel = NeuCor::NEURON_MODEL_STANDARD;
+NeuCor::plasticityRules plasticityRule = NeuCor::PLASTICITY_TRACE;
+MetricsExporter::Options metricsOptions;
+#ifdef __EMSCRIPTEN__
+std::size_t flightRecorderSize = 0;
+#else
+std::size_t flightRecorderSize = std::size_t(1) << 21;
+#endif
+const char* flightRecordPath = "neurocorrelation_flight.bin";
 void windowDestroy() {
     windowDestroyed = true;
 }
@@ -30,12 +51,28 @@ EMSCRIPTEN_KEEPALIVE void neurocorrelation_request_shutdown() {
 
 void showUsage(){
     printf("Neuro Correlation usage: "
-           "[--help] [--seed <value>] <simulation preset>"
+           "[--help] [--seed <value>] [--deterministic] [--bulk-build <threads>] [--time-resolution <ticks/ms>] [--neuron-model <model>] [--plasticity <rule>] [--fixed-point] [--hybrid] [--sim-thread] [--perf] [--metrics-file <path>] [--metrics-port <port>]\n"
+           "\t[--flight-recorder <events>] [--print-flight-record <file>] <simulation preset>"
            "\nThe following are the preset simulations:\n"
            "\tSTANDARD - (default) Creates 750 neurons, 3 inputs (2 of them linked)\n"
            "\tUSER_INPUT - Prompts about number of neurons, inputs, and linked inputs\n"
            "\tFEW_NEURONS - Creates only a few connected neurons\n"
            "\tONE_INPUT - Creates 750 neurons, and 1 input\n"
+           "--deterministic runs the network in deterministic mode: identical seeds give identical simulations\n"
+           "--bulk-build builds the network on the given number of threads (0 for all), for large networks. Implies --deterministic\n"
+           "--time-resolution sets how many integer time ticks make up one simulated ms (default 1000)\n"
+           "--neuron-model selects the neuron dynamics: standard (default), lif or izhikevich\n"
+           "--plasticity selects the plasticity rule: trace (default), nearest, multiplicative or triplet\n"
+           "--fixed-point updates potentials, traces and weights with integer arithmetic, for the same results on every platform\n"
+           "--hybrid updates neurons that receive many spikes on a clock and the rest only on events, instead of updating all neurons\n"
+           "--sim-thread runs the simulation on its own thread, so that simulation speed and frame rate are independent\n"
+           "--perf prints hardware performance counters (Linux perf events) per simulated event on exit\n"
+           "--metrics-file writes Prometheus text format metrics to the given file every 5 seconds\n"
+           "--metrics-port serves the same metrics on http://127.0.0.1:<port>/metrics\n"
+           "--flight-recorder sets how many recent events are kept for post-mortem dumps (default 2097152, 0 disables).\n"
+           "\tThe record is dumped to neurocorrelation_flight.bin on a crash or failed assert, and as text to\n"
+           "\tneurocorrelation_flight.bin.txt on SIGUSR1\n"
+           "--print-flight-record prints a binary flight record as text and exits\n"
            );
 }
 
@@ -45,6 +82,17 @@ namespace SIMULATIONS {
         return (static_cast<float>(rand()) / static_cast<float>(RAND_MAX)) * 75.0f;
     }
 
+    std::unique_ptr<NeuCor> createBrain(int n_neurons) {
+        std::unique_ptr<NeuCor> brain(0 <= buildThreads ? new NeuCor(n_neurons, seed, buildThreads)
+                                      : deterministic ? new NeuCor(n_neurons, seed) : new NeuCor(n_neurons));
+        if (timeResolution != 0) brain->setTimeResolution(timeResolution);
+        brain->setNeuronModel(neuronModel);
+        brain->setPlasticityRule(plasticityRule);
+        brain->hybrid = hybridScheduling;
+        if (fixedPoint && !brain->setFixedPoint(true)) fprintf(stderr, "The fixed point kernels don't support the Izhikevich model\n");
+        return brain;
+    }
+
     struct SimulationSession {
         std::unique_ptr<NeuCor> brain;
         std::unique_ptr<NeuCor_Renderer> renderer;
@@ -52,9 +100,16 @@ namespace SIMULATIONS {
         std::vector<float> inputRadius;
         std::vector<coord3> inputPositions;
         std::function<void(SimulationSession&)> onFrame;
+        std::unique_ptr<PerfProfile> perf;
+        std::unique_ptr<MetricsExporter> metrics;
+        std::unique_ptr<FlightRecorder> flightRecorder;
+        std::unique_ptr<SimulationThread> simulation; // Declared after brain, so that it stops before the brain is destroyed
 
         void tick() {
-            if (onFrame) onFrame(*this);
+            if (onFrame) {
+                std::unique_lock<std::mutex> lock = simulation ? simulation->lockNetwork() : std::unique_lock<std::mutex>();
+                onFrame(*this);
+            }
             renderer->pollWindow();
             if (!windowDestroyed) renderer->updateView();
         }
@@ -67,18 +122,38 @@ namespace SIMULATIONS {
         session->brain = std::move(brain);
         session->renderer.reset(new NeuCor_Renderer(session->brain.get()));
         session->renderer->setDestructCallback(windowDestroy);
+        if (perfCounters) {
+            session->perf.reset(new PerfProfile());
+            session->brain->setPerfProfile(session->perf.get());
+        }
+        if (flightRecorderSize != 0) {
+            session->flightRecorder.reset(new FlightRecorder(flightRecorderSize));
+            session->flightRecorder->installSignalHandlers(flightRecordPath);
+            session->brain->setFlightRecorder(session->flightRecorder.get());
+        }
+        if (simulationThread) {
+            session->simulation.reset(new SimulationThread(session->brain.get()));
+            session->renderer->setSimulationThread(session->simulation.get());
+        }
+        if (!metricsOptions.filePath.empty() || metricsOptions.httpPort != 0) {
+            session->metrics.reset(new MetricsExporter(session->brain.get()));
+            if (!session->metrics->start(metricsOptions)) session->metrics.reset();
+        }
         return session;
     }
 
     void runSession(std::unique_ptr<SimulationSession> session) {
         std::cout<<"Starting program loop\n";
+        if (session->simulation) session->simulation->start();
         while (!windowDestroyed) {
             session->tick();
         }
+        if (session->simulation) session->simulation->stop();
+        if (session->perf) session->perf->report(std::cout);
     }
 
     std::unique_ptr<SimulationSession> buildStandard() {
-        std::unique_ptr<SimulationSession> session = createSession(std::unique_ptr<NeuCor>(new NeuCor(750)));
+        std::unique_ptr<SimulationSession> session = createSession(createBrain(750));
         session->renderer->runBrainOnUpdate = true;
         session->renderer->realRunspeed = true;
         session->brain->runSpeed = 4;
@@ -97,27 +172,19 @@ namespace SIMULATIONS {
             session->inputRadius.data()
         );
 
-        session->onFrame = [](SimulationSession& state) {
-            for (float& input : state.inputs) {
-                input += ((static_cast<float>(rand()) / static_cast<float>(RAND_MAX)) - 0.5f) * 2.0f;
-                input = std::clamp(input, 0.0f, 75.0f);
-            }
-            state.inputs[1] = state.inputs[0];
-
-            if (10000.0f < state.brain->getTime()) {
-                state.brain->learningRate = 0;
-                state.inputs[0] = 0.0f;
-                state.inputs[1] = 0.0f;
-                state.inputs[2] = 0.0f;
+        // Inputs 0 and 2 take random walks (about the per-frame +-1 Hz steps at 60 fps and 4 ms/s), and input 1 follows input 0.
+        // After 10 s, learning stops and the inputs are probed one at a time.
+        session->brain->scheduleInputRandomWalk(0, 0.0f, session->inputs[0], 4.0f, 1.0f, 0.0f, 75.0f);
+        session->brain->scheduleInputLink(1, 0.0f, 0);
+        session->brain->scheduleInputRandomWalk(2, 0.0f, session->inputs[2], 4.0f, 1.0f, 0.0f, 75.0f);
+        session->brain->scheduleInputRate(0, 10000.0f, 0.0f);
+        session->brain->scheduleInputRate(2, 10000.0f, 0.0f);
+        session->brain->scheduleInputRate(2, 10200.0f, 50.0f);
+        session->brain->scheduleInputRate(2, 10600.0f, 0.0f);
+        session->brain->scheduleInputRate(0, 10800.0f, 50.0f);
 
-                if (10800.0f < state.brain->getTime()) {
-                    state.inputs[0] = 50.0f;
-                    state.inputs[1] = 50.0f;
-                }
-                else if (10200.0f < state.brain->getTime() && state.brain->getTime() <= 10600.0f) {
-                    state.inputs[2] = 50.0f;
-                }
-            }
+        session->onFrame = [](SimulationSession& state) {
+            if (10000.0f < state.brain->getTime()) state.brain->learningRate = 0;
         };
 
         return session;
@@ -137,8 +204,8 @@ namespace SIMULATIONS {
             inputLinks = std::min(n_inputs / 2, inputLinks);
         }
 
-        std::unique_ptr<SimulationSession> session = createSession(std::unique_ptr<NeuCor>(new NeuCor(n_neurons)));
-        session->brain->runAll = true;
+        std::unique_ptr<SimulationSession> session = createSession(createBrain(n_neurons));
+        session->brain->runAll = !session->brain->hybrid; // Hybrid scheduling replaces updating every neuron
         session->brain->runSpeed = 0.02f;
         session->renderer->realRunspeed = false;
         session->renderer->runBrainOnUpdate = true;
@@ -150,18 +217,16 @@ namespace SIMULATIONS {
         session->brain->setInputRateArray(session->inputs.data(), session->inputs.size());
         session->brain->setDetectors(1);
 
-        session->onFrame = [inputLinks](SimulationSession& state) {
-            for (int i = 0; i < inputLinks; ++i) {
-                state.inputs[i * 2 + 1] = state.inputs[i * 2];
-            }
-        };
+        for (int i = 0; i < inputLinks; ++i) {
+            session->brain->scheduleInputLink(i * 2 + 1, 0.0f, i * 2);
+        }
 
         return session;
     }
 
     std::unique_ptr<SimulationSession> buildFewNeurons() {
-        std::unique_ptr<SimulationSession> session = createSession(std::unique_ptr<NeuCor>(new NeuCor(0)));
-        session->brain->runAll = true;
+        std::unique_ptr<SimulationSession> session = createSession(createBrain(0));
+        session->brain->runAll = !session->brain->hybrid; // Hybrid scheduling replaces updating every neuron
         session->brain->runSpeed = 0.02f;
         session->renderer->realRunspeed = false;
         session->renderer->runBrainOnUpdate = true;
@@ -189,7 +254,7 @@ namespace SIMULATIONS {
     }
 
     std::unique_ptr<SimulationSession> buildOneInput() {
-        std::unique_ptr<SimulationSession> session = createSession(std::unique_ptr<NeuCor>(new NeuCor(750)));
+        std::unique_ptr<SimulationSession> session = createSession(createBrain(750));
         session->renderer->runBrainOnUpdate = true;
         session->renderer->realRunspeed = true;
 
@@ -254,7 +319,7 @@ namespace {
 #endif
 
 int main(int argc, char* argv[]){
-    unsigned seed = time(NULL);
+    seed = time(NULL);
     std::string simulation = "STANDARD";
     
     // Interpret arguments
@@ -272,6 +337,90 @@ int main(int argc, char* argv[]){
             seed = std::stoul(argv[i+1], nullptr, 0);
             i++;
         }
+        else if (arg == "--deterministic"){
+            deterministic = true;
+        }
+        else if (arg == "--bulk-build"){
+            if (i+1 == argc || std::stol(argv[i+1], nullptr, 0) < 0){
+                fprintf(stderr, "Missing or invalid number of build threads\n");
+                return 1;
+            }
+            buildThreads = std::stol(argv[i+1], nullptr, 0);
+            i++;
+        }
+        else if (arg == "--time-resolution"){
+            if (i+1 == argc || std::stol(argv[i+1], nullptr, 0) <= 0){
+                fprintf(stderr, "Missing or invalid time resolution\n");
+                return 1;
+            }
+            timeResolution = std::stol(argv[i+1], nullptr, 0);
+            i++;
+        }
+        else if (arg == "--neuron-model"){
+            std::string const model = i+1 == argc ? "" : argv[i+1];
+            if (model == "standard") neuronModel = NeuCor::NEURON_MODEL_STANDARD;
+            else if (model == "lif") neuronModel = NeuCor::NEURON_MODEL_LIF;
+            else if (model == "izhikevich") neuronModel = NeuCor::NEURON_MODEL_IZHIKEVICH;
+            else {
+                fprintf(stderr, "Missing or invalid neuron model\n");
+                return 1;
+            }
+            i++;
+        }
+        else if (arg == "--plasticity"){
+            std::string const rule = i+1 == argc ? "" : argv[i+1];
+            if (rule == "trace") plasticityRule = NeuCor::PLASTICITY_TRACE;
+            else if (rule == "nearest") plasticityRule = NeuCor::PLASTICITY_NEAREST_ADDITIVE;
+            else if (rule == "multiplicative") plasticityRule = NeuCor::PLASTICITY_NEAREST_MULTIPLICATIVE;
+            else if (rule == "triplet") plasticityRule = NeuCor::PLASTICITY_TRIPLET;
+            else {
+                fprintf(stderr, "Missing or invalid plasticity rule\n");
+                return 1;
+            }
+            i++;
+        }
+        else if (arg == "--fixed-point"){
+            fixedPoint = true;
+        }
+        else if (arg == "--hybrid"){
+            hybridScheduling = true;
+        }
+        else if (arg == "--sim-thread"){
+#ifdef __EMSCRIPTEN__
+            fprintf(stderr, "--sim-thread is not supported in the browser build\n");
+#else
+            simulationThread = true;
+#endif
+        }
+        else if (arg == "--perf"){
+            perfCounters = true;
+        }
+        else if (arg == "--flight-recorder" || arg == "--print-flight-record"){
+            if (i+1 == argc){
+                fprintf(stderr, "Missing %s value\n", arg.c_str());
+                return 1;
+            }
+            if (arg == "--flight-recorder") flightRecorderSize = std::stoul(argv[i+1], nullptr, 0);
+            else {
+                std::vector<FlightRecorder::Entry> entries;
+                if (!FlightRecorder::readRaw(argv[i+1], entries)){
+                    fprintf(stderr, "Could not read flight record %s\n", argv[i+1]);
+                    return 1;
+                }
+                FlightRecorder::print(std::cout, entries);
+                return 0;
+            }
+            i++;
+        }
+        else if (arg == "--metrics-file" || arg == "--metrics-port"){
+            if (i+1 == argc){
+                fprintf(stderr, "Missing %s value\n", arg.c_str());
+                return 1;
+            }
+            if (arg == "--metrics-file") metricsOptions.filePath = argv[i+1];
+            else metricsOptions.httpPort = static_cast<unsigned short>(std::stoul(argv[i+1], nullptr, 0));
+            i++;
+        }
         else if (i != 0){
             simulation = arg;
         }
@@ -281,6 +430,7 @@ int main(int argc, char* argv[]){
     // Set seed
     srand(seed);
     printf("Using seed %u\n", seed);
+    if (perfCounters && simulationThread) fprintf(stderr, "Hardware counters only count the thread which opened them, so --perf doesn't cover --sim-thread\n");
     fflush(stdout);
 
     // Start simulation
@@ -0,0 +1,360 @@
+#include "NeuCor.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <map>
+#include <utility>
+#include <vector>
+#include <stdio.h>
+
+// Regression tests of the simulation core. Each test returns true if it passed.
+
+namespace {
+// Exposes the network's internals that the tests look at
+struct TestNetwork: public NeuCor {
+    using NeuCor::NeuCor;
+    using NeuCor::getNeuron;
+    using NeuCor::getSynapse;
+    using NeuCor::inputHandler;
+    using NeuCor::positions;
+};
+
+bool check(bool condition, const char* description){
+    if (!condition) printf("\tFailed: %s\n", description);
+    return condition;
+}
+
+// Identical seeds give bit-identical spike trains and weights
+bool seededRunsAreIdentical(){
+    struct Run {
+        std::vector<std::pair<double, std::size_t>> spikes;
+        std::vector<NeuCor::SynapseSnapshot> synapses;
+    };
+    auto record = [](){
+        Run result;
+        NeuCor network(200, 4);
+        float rates[] = {40.0f, 60.0f};
+        network.setInputRateArray(rates, 2);
+        network.addSpikeObserver([&result](const NeuCor::SpikeEvent* spikes, std::size_t count){
+            for (std::size_t i = 0; i<count; i++) result.spikes.emplace_back(spikes[i].time, spikes[i].id);
+        });
+        for (int step = 0; step<100; step++) network.run();
+        network.getSynapseSnapshots(result.synapses);
+        return result;
+    };
+    const Run a = record(), b = record();
+
+    bool passed = check(!a.spikes.empty() && a.spikes == b.spikes, "same spikes at the same times");
+    bool sameWeights = !a.synapses.empty() && a.synapses.size() == b.synapses.size();
+    for (std::size_t i = 0; sameWeights && i<a.synapses.size(); i++)
+        sameWeights = a.synapses[i].fromID == b.synapses[i].fromID && a.synapses[i].toID == b.synapses[i].toID
+            && std::memcmp(&a.synapses[i].weight, &b.synapses[i].weight, sizeof(float)) == 0;
+    passed &= check(sameWeights, "bitwise identical weights");
+    return passed;
+}
+
+// Durations are rounded to ticks once, and runFor() splits its target into slices of at most sliceLength
+bool runForSlicesTicks(){
+    NeuCor network(50, 1);
+    network.runSpeed = 2.5f;
+    bool passed = check(network.setTimeResolution(10), "resolution can be set before anything ran");
+    passed &= check(network.toTicks(0.26f) == 3 && network.toMs(3) == 0.3f, "durations round to the nearest tick");
+
+    NeuCor::RunProgress progress = network.runFor(10.26f, 1e9f, 1.0f);
+    passed &= check(network.getTicks() == 103 && progress.simulated == network.toMs(103) && progress.remaining == 0.0f,
+        "runFor() advances by its target rounded to ticks");
+    passed &= check(progress.slices == 11, "ten 1 ms slices and the 0.3 ms rest");
+    passed &= check(network.runSpeed == 2.5f, "runSpeed is restored");
+    passed &= check(!network.setTimeResolution(1000) && network.getTimeResolution() == 10, "resolution can't be changed after running");
+
+    progress = network.runFor(50.0f, 0.0f, 1.0f);
+    passed &= check(progress.slices == 1 && progress.simulated == 1.0f && progress.remaining == 49.0f, "an exhausted wall budget still runs one slice");
+    return passed;
+}
+
+// Schedules and links take effect at their simulated times, whatever the step length
+bool schedulesFollowSimulatedTime(){
+    struct Rates {
+        float before, scheduled, unlinked, linked, relinked;
+    };
+    auto schedule = [](TestNetwork& network, float* rates){
+        network.setInputRateArray(rates, 2);
+        network.scheduleInputRate(0, 5.0f, 250.0f);
+        network.scheduleInputLink(1, 12.0f, 0);
+        network.scheduleInputRate(0, 20.0f, 50.0f);
+    };
+    float rates[] = {10.0f, 20.0f}, otherRates[] = {10.0f, 20.0f};
+    TestNetwork stepped(100, 2), sliced(100, 2);
+    schedule(stepped, rates), schedule(sliced, otherRates);
+
+    Rates observed = {};
+    for (int step = 1; step<=30; step++){
+        stepped.run(); // The rates of the step's last ms
+        if (step == 4) observed.before = stepped.getInputRate(0);
+        if (step == 10) observed.scheduled = stepped.getInputRate(0), observed.unlinked = stepped.getInputRate(1);
+        if (step == 16) observed.linked = stepped.getInputRate(1);
+        if (step == 25) observed.relinked = stepped.getInputRate(1);
+    }
+    sliced.runFor(30.0f, 1e9f, 0.7f);
+
+    bool passed = check(observed.before == 10.0f && observed.scheduled == 250.0f, "input rate array until the scheduled segment starts");
+    passed &= check(observed.unlinked == 20.0f && observed.linked == 250.0f, "linked input follows the array until its link starts, then its source");
+    passed &= check(observed.relinked == 50.0f, "linked input follows later changes of its source");
+    passed &= check(stepped.inputHandler[0].lastFire == sliced.inputHandler[0].lastFire && stepped.inputHandler[1].lastFire == sliced.inputHandler[1].lastFire,
+        "same firing times with 1 ms steps and 0.7 ms slices");
+    return passed;
+}
+
+// Injected stimuli are applied in time order at their simulated time, and those in the past at the start of the next step
+bool stimuliApplyInTimeOrder(){
+    NeuCor network(50, 3);
+    network.enableStimuli();
+    std::vector<std::pair<double, std::size_t>> spikes;
+    network.addSpikeObserver([&spikes](const NeuCor::SpikeEvent* events, std::size_t count){
+        for (std::size_t i = 0; i<count; i++) spikes.emplace_back(events[i].time, events[i].id);
+    }, {10, 11, 12});
+    auto firstSpike = [&spikes](std::size_t ID){
+        for (const auto &spike: spikes) if (spike.second == ID) return spike.first;
+        return -1.0;
+    };
+
+    bool passed = check(network.injectSpike(10, 5.0f) && network.injectSpike(11, 3.0f), "stimuli are queued");
+    while (network.getTime() < 10.0) network.run();
+    passed &= check(firstSpike(11) == 3.0 && firstSpike(10) == 5.0, "spikes at their injected times, the earlier first");
+
+    network.injectSpike(12, 2.0f); // Already past
+    network.run();
+    passed &= check(firstSpike(12) == 10.0, "a stimulus in the past is applied at the start of the step");
+    return passed;
+}
+
+// Observers get at most one batch per step, of the step's events in time order, filtered to their neurons
+bool observersGetStepBatches(){
+    TestNetwork network(200, 6);
+    float rates[] = {40.0f, 60.0f};
+    network.setInputRateArray(rates, 2);
+
+    std::vector<NeuCor::SpikeEvent> all, some;
+    std::map<std::pair<std::size_t, std::size_t>, float> lastWeights;
+    double stepStart = 0.0;
+    int batches = 0, steps = 0;
+    bool ordered = true, inStep = true;
+    const unsigned allHandle = network.addSpikeObserver([&](const NeuCor::SpikeEvent* spikes, std::size_t count){
+        batches++;
+        for (std::size_t i = 0; i<count; i++){
+            ordered = ordered && (i == 0 || spikes[i-1].time <= spikes[i].time);
+            inStep = inStep && stepStart <= spikes[i].time && spikes[i].time <= network.getTime();
+            all.push_back(spikes[i]);
+        }
+    });
+    const std::vector<std::size_t> observed = {3, 4, 5, 50};
+    network.addSpikeObserver([&some](const NeuCor::SpikeEvent* spikes, std::size_t count){some.insert(some.end(), spikes, spikes+count);}, observed);
+    network.addWeightObserver([&lastWeights](const NeuCor::WeightEvent* changes, std::size_t count){
+        for (std::size_t i = 0; i<count; i++) lastWeights[{changes[i].fromID, changes[i].toID}] = changes[i].weight;
+    });
+    for (; steps<50; steps++) stepStart = network.getTime(), network.run();
+
+    bool passed = check(!all.empty() && batches <= steps, "at most one batch per step");
+    passed &= check(ordered && inStep, "batches are in time order, within their step");
+    std::vector<NeuCor::SpikeEvent> expected;
+    for (const auto &spike: all) if (std::find(observed.begin(), observed.end(), spike.id) != observed.end()) expected.push_back(spike);
+    bool sameFiltered = !expected.empty() && expected.size() == some.size();
+    for (std::size_t i = 0; sameFiltered && i<some.size(); i++) sameFiltered = some[i].time == expected[i].time && some[i].id == expected[i].id;
+    passed &= check(sameFiltered, "filtered observer gets exactly its neurons' spikes");
+    bool latestWeights = !lastWeights.empty();
+    for (const auto &change: lastWeights) latestWeights = latestWeights && network.getSynapse(change.first.first, change.first.second)->getWeight() == change.second;
+    passed &= check(latestWeights, "the last change of every synapse is its current weight");
+
+    const std::size_t before = all.size();
+    network.removeObserver(allHandle);
+    for (int step = 0; step<10; step++) network.run();
+    passed &= check(all.size() == before, "removed observer isn't called");
+    return passed;
+}
+
+// Incremental snapshots contain what was edited since the given epoch, and everything after renumbering
+bool snapshotsFollowEdits(){
+    TestNetwork network(100, 8);
+    network.learningRate = 0.0f; // Only the edits change weights
+    std::vector<NeuCor::NeuronSnapshot> neurons;
+    std::vector<NeuCor::SynapseSnapshot> synapses;
+    network.run();
+    std::uint64_t since = network.getSynapseSnapshots(synapses);
+    network.run();
+
+    std::vector<NeuCor::SynapseSnapshot> all;
+    network.getSynapseSnapshots(all);
+    const std::size_t target = std::find_if(all.begin(), all.end(), [](const NeuCor::SynapseSnapshot& synapse){ return synapse.fromID == 7; })->toID;
+    network.getNeuron(7)->setPosition({0.25f, 0.5f, 0.75f});
+    network.getSynapse(7, target)->setWeight(0.125f);
+    network.deleteNeuron(9);
+    std::uint64_t const epoch = network.getSynapseSnapshots(synapses, since);
+    bool passed = check(synapses.size() == 1 && synapses[0].fromID == 7 && synapses[0].toID == target && synapses[0].weight == 0.125f,
+        "only the edited synapse, with its new weight");
+    network.getNeuronSnapshots(neurons, since);
+    bool sawMoved = false, sawDeleted = false;
+    for (const auto &neuron: neurons){
+        sawMoved = sawMoved || (neuron.id == 7 && neuron.position.x == 0.25f && neuron.position.y == 0.5f && neuron.position.z == 0.75f);
+        sawDeleted = sawDeleted || (neuron.id == 9 && neuron.position.x != neuron.position.x);
+    }
+    passed &= check(sawMoved, "moved neuron at its new position");
+    passed &= check(sawDeleted, "deleted neuron with a NAN position");
+
+    network.getSynapseSnapshots(synapses, epoch);
+    passed &= check(synapses.size() == 1, "edits since the returned epoch are reported again until the next run()");
+    network.run();
+    since = network.getSynapseSnapshots(synapses, network.getEpoch());
+    passed &= check(synapses.empty(), "nothing after the edits");
+
+    network.renumberNeurons();
+    network.getSynapseSnapshots(synapses, since);
+    network.getSynapseSnapshots(all);
+    passed &= check(!all.empty() && synapses.size() == all.size(), "everything after renumbering");
+    return passed;
+}
+
+// Renumbering moves neurons, but keeps every position, synapse and weight, and the in-synapse maps consistent
+bool renumberingKeepsTopology(){
+    TestNetwork network(300, 5);
+    float rates[] = {40.0f, 60.0f};
+    network.setInputRateArray(rates, 2);
+    for (int step = 0; step<20; step++) network.run(); // So that weights differ from their initial values
+    std::vector<NeuCor::NeuronSnapshot> oldNeurons;
+    std::vector<NeuCor::SynapseSnapshot> oldSynapses;
+    network.getNeuronSnapshots(oldNeurons);
+    network.getSynapseSnapshots(oldSynapses);
+
+    std::reverse(network.positions.begin(), network.positions.end()); // Far from Morton order, so that most neurons move
+    for (auto &neuron: oldNeurons) neuron.position = network.positions[network.getNeuron(neuron.id)->pos];
+    const std::vector<std::size_t> newIDs = network.renumberNeurons();
+
+    std::size_t moved = 0;
+    bool samePositions = newIDs.size() == oldNeurons.size();
+    for (const auto &neuron: oldNeurons){
+        const coord3 p = network.getNeuron(newIDs[neuron.id])->position();
+        samePositions = samePositions && p.x == neuron.position.x && p.y == neuron.position.y && p.z == neuron.position.z;
+        if (newIDs[neuron.id] != neuron.id) moved++;
+    }
+    bool passed = check(0 < moved, "neurons are renumbered");
+    passed &= check(samePositions, "every neuron keeps its position");
+
+    std::vector<NeuCor::SynapseSnapshot> newSynapses;
+    network.getSynapseSnapshots(newSynapses);
+    bool sameSynapses = !oldSynapses.empty() && oldSynapses.size() == newSynapses.size();
+    for (const auto &synapse: oldSynapses){
+        const Synapse* renumbered = network.getSynapse(newIDs[synapse.fromID], newIDs[synapse.toID]);
+        sameSynapses = sameSynapses && renumbered && renumbered->getWeight() == synapse.weight;
+    }
+    passed &= check(sameSynapses, "every synapse keeps its weight");
+
+    bool consistent = true;
+    std::size_t inCount = 0;
+    for (std::size_t ID = 0; ID<network.getNeuronCount(); ID++){
+        for (const auto &in: network.getNeuron(ID)->inSynapses){
+            consistent = consistent && in.second == ID && network.getSynapse(in.first, in.second) != nullptr;
+            inCount++;
+        }
+    }
+    passed &= check(consistent && inCount == newSynapses.size(), "in-synapse maps match the synapses");
+    return passed;
+}
+
+// A deleted neuron's ID is reused by the next created neuron, after the network has compacted it away
+bool staleHandlesStayDead(){
+    TestNetwork network(50, 1);
+    network.runSpeed = 1.0f;
+    const NeuCor::NeuronHandle before = network.getNeuronHandle(5);
+    network.getNeuron(5)->scheduleFire(150.0f); // Still pending when the slot is reused
+    network.deleteNeuron(5);
+    const NeuCor::NeuronHandle deleted = network.getNeuronHandle(5);
+
+    bool passed = check(!network.isAlive(before), "handle is dead after deleteNeuron()");
+    passed &= check(!network.isAlive(deleted), "handle of a deleted neuron is dead");
+    for (int step = 0; step<100; step++) network.run(); // Compacts the deleted neuron, which frees its ID
+
+    const NeuCor::NeuronHandle reused = network.createNeuron({0.0f, 0.0f, 0.0f});
+    passed &= check(reused.id == before.id, "ID of the deleted neuron is reused");
+    passed &= check(network.isAlive(reused), "handle of the new neuron is alive");
+    passed &= check(!network.isAlive(before), "handle from before deletion stays dead after reuse");
+    passed &= check(!network.isAlive(deleted), "handle of the deleted neuron stays dead after reuse");
+
+    // The slot's new neuron starts from scratch, not where the deleted one left off
+    Neuron* neuron = network.getNeuron(reused.id);
+    passed &= check(neuron->lastRan == network.getTicks(), "reused slot was last run when it was created");
+    while (network.getTicks() < network.toTicks(150.0f)) network.run();
+    neuron->run(); // At the deleted neuron's scheduled fire time
+    passed &= check(neuron->lastFire != network.toTicks(150.0f), "reused slot doesn't fire at the deleted neuron's scheduled time");
+    return passed;
+}
+
+// Bulk construction splits its work into fixed chunks, so the network depends on the seed but not on the thread count
+bool bulkBuildIgnoresThreads(){
+    NeuCor one(10000, 7, 1), several(10000, 7, 4); // More neurons than one chunk (4096)
+    std::vector<NeuCor::SynapseSnapshot> oneSynapses, severalSynapses;
+    one.getSynapseSnapshots(oneSynapses);
+    several.getSynapseSnapshots(severalSynapses);
+
+    bool passed = check(!oneSynapses.empty() && oneSynapses.size() == severalSynapses.size(), "same number of synapses");
+    bool sameSynapses = passed, sameGenerations = passed;
+    for (std::size_t i = 0; sameSynapses && i<oneSynapses.size(); i++){
+        const NeuCor::SynapseSnapshot &a = oneSynapses[i], &b = severalSynapses[i];
+        sameSynapses = a.fromID == b.fromID && a.toID == b.toID && a.weight == b.weight;
+        sameGenerations = sameGenerations && one.getSynapseHandle(a.fromID, a.toID).generation == several.getSynapseHandle(b.fromID, b.toID).generation;
+    }
+    passed &= check(sameSynapses, "same synapses in the same order");
+    passed &= check(sameGenerations, "same synapse generations");
+    passed &= check(one.getCounters().meanWeight == several.getCounters().meanWeight, "same mean weight");
+
+    for (int step = 0; step<5; step++) one.run(), several.run(); // Also goes through the in synapses, which are built separately
+    passed &= check(0 < one.getCounters().spikes && one.getCounters().spikes == several.getCounters().spikes, "same spikes when run");
+    return passed;
+}
+
+// Clock driven neurons are charged as if they had stayed event driven, so hybrid scheduling fires as often as event driven scheduling.
+// Spikes are only fired at clock updates, so the clock is fine enough for that not to matter. Single seeds differ by up to 15%
+std::uint64_t spikesOver(std::uint32_t seed, bool hybrid){
+    NeuCor network(300, seed);
+    network.runAll = false, network.hybrid = hybrid;
+    network.clockDrivenPeriod = 0.1f;
+    float rates[] = {40.0f, 60.0f};
+    network.setInputRateArray(rates, 2);
+    network.runSpeed = 1.0f;
+    while (network.getTime() < 300.0) network.run();
+    return network.getCounters().spikes;
+}
+bool hybridMatchesEventDriven(){
+    std::uint64_t eventSpikes = 0, hybridSpikes = 0;
+    for (std::uint32_t seed = 1; seed<=3; seed++) eventSpikes += spikesOver(seed, false), hybridSpikes += spikesOver(seed, true);
+    printf("\t%llu spikes event driven, %llu hybrid\n", static_cast<unsigned long long>(eventSpikes), static_cast<unsigned long long>(hybridSpikes));
+    return check(0 < eventSpikes && std::abs(double(hybridSpikes) - double(eventSpikes)) < 0.1*double(eventSpikes), "hybrid spike count within 10% of event driven");
+}
+}
+
+int main(){
+    struct Test {
+        const char* name;
+        bool (*run)();
+    };
+    const Test tests[] = {
+        {"seededRunsAreIdentical", seededRunsAreIdentical},
+        {"runForSlicesTicks", runForSlicesTicks},
+        {"schedulesFollowSimulatedTime", schedulesFollowSimulatedTime},
+        {"stimuliApplyInTimeOrder", stimuliApplyInTimeOrder},
+        {"observersGetStepBatches", observersGetStepBatches},
+        {"snapshotsFollowEdits", snapshotsFollowEdits},
+        {"renumberingKeepsTopology", renumberingKeepsTopology},
+        {"staleHandlesStayDead", staleHandlesStayDead},
+        {"bulkBuildIgnoresThreads", bulkBuildIgnoresThreads},
+        {"hybridMatchesEventDriven", hybridMatchesEventDriven},
+    };
+
+    int failed = 0;
+    for (const Test& test: tests){
+        const bool passed = test.run();
+        printf("%s: %s\n", test.name, passed ? "ok" : "FAILED");
+        if (!passed) failed++;
+    }
+    return failed == 0 ? 0 : 1;
+}
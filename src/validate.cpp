@@ -0,0 +1,82 @@
+#include "NeuCor.h"
+#include "NeuCor_Validation.h"
+
+#include <iostream>
+#include <string>
+#include <stdlib.h>
+
+void showUsage(){
+    printf("Neuro Correlation validation usage: "
+           "[--help] [--seed <value>] [--seeds <count>] [--stream-seed <value>] [--neurons <count>] [--duration <ms>] [--step <ms>]\n"
+           "\t[--tolerance <standard errors>] [--exact] <engine variant A> <engine variant B>\n"
+           "Runs both engine variants on the networks of --seeds consecutive seeds from --seed, and compares the seed means\n"
+           "of spike and weight statistics against their seed-to-seed spread. Exits with 0 if all of them are within tolerance.\n"
+           "--exact instead requires the runs to be bitwise identical for every seed, which deterministic variants can be.\n"
+           "--stream-seed reseeds the random stream of the B runs after the network is constructed.\n"
+           "The following are the engine variants:\n");
+    for (const auto &variant: NeuCor_Validator::variants())
+        printf("\t%s - %s\n", variant.name.c_str(), variant.description.c_str());
+}
+
+int main(int argc, char* argv[]){
+    NeuCor_Validator::Options options;
+    std::vector<std::string> variantNames;
+    unsigned streamSeed = 0;
+
+    // Interpret arguments
+    for (int i = 1; i < argc; i++){
+        std::string arg = argv[i];
+        if (arg == "--help") {
+            showUsage();
+            return 0;
+        }
+        else if (arg == "--exact") options.exact = true;
+        else if (arg.rfind("--", 0) == 0){
+            if (i+1 == argc){
+                fprintf(stderr, "Missing %s value\n", arg.c_str());
+                return 1;
+            }
+            std::string value = argv[++i];
+            if (arg == "--seed") options.seed = std::stoul(value, nullptr, 0);
+            else if (arg == "--seeds") options.seeds = std::stoul(value, nullptr, 0);
+            else if (arg == "--stream-seed") streamSeed = std::stoul(value, nullptr, 0);
+            else if (arg == "--neurons") options.neurons = std::stoi(value);
+            else if (arg == "--duration") options.duration = std::stof(value);
+            else if (arg == "--step") options.step = std::stof(value);
+            else if (arg == "--tolerance") options.tolerance = std::stof(value);
+            else {
+                fprintf(stderr, "Unknown option %s\n", arg.c_str());
+                return 1;
+            }
+        }
+        else variantNames.push_back(arg);
+    }
+
+    if (variantNames.size() != 2){
+        showUsage();
+        return 1;
+    }
+    if (options.seeds == 0 || (options.seeds == 1 && !options.exact)){
+        fprintf(stderr, "At least 2 seeds are needed for their spread, or 1 with --exact\n");
+        return 1;
+    }
+    const NeuCor_Validator::EngineVariant* variantA = NeuCor_Validator::findVariant(variantNames[0]);
+    const NeuCor_Validator::EngineVariant* variantB = NeuCor_Validator::findVariant(variantNames[1]);
+    if (variantA == nullptr || variantB == nullptr){
+        fprintf(stderr, "Engine variant not found\n");
+        return 1;
+    }
+
+    printf("Using seeds %u to %u, %i neurons, %.0f ms\n", options.seed, options.seed + options.seeds - 1, options.neurons, options.duration);
+    fflush(stdout);
+
+    std::vector<NeuCor_Validator::Record> recordsA = NeuCor_Validator::recordSeeds(*variantA, options);
+    NeuCor_Validator::Options optionsB = options;
+    optionsB.streamSeed = streamSeed;
+    std::vector<NeuCor_Validator::Record> recordsB = NeuCor_Validator::recordSeeds(*variantB, optionsB);
+    NeuCor_Validator::Report report = NeuCor_Validator::compare(recordsA, recordsB, options);
+
+    std::cout<<variantA->name<<" vs "<<variantB->name<<'\n';
+    report.print(std::cout);
+    return report.passed() ? 0 : 1;
+}
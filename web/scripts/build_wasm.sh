@@ -27,12 +27,21 @@ docker run --rm \
     em++ \
       -std=c++17 \
       -O2 \
+      -ffp-contract=off \
       -Iimgui \
       -Iimgui/backends \
       -Itinyexpr \
       -I/tmp/vendor \
       src/main.cpp \
       src/NeuCor.cpp \
+      src/NeuCor_Perf.cpp \
+      src/NeuCor_Metrics.cpp \
+      src/NeuCor_Validation.cpp \
+      src/NeuCor_FlightRecorder.cpp \
+      src/NeuCor_SimulationThread.cpp \
+      src/NeuCor_Stimulus.cpp \
+      src/NeuCor_Generations.cpp \
+      src/NeuCor_Arena.cpp \
       src/NeuCor_Renderer.cpp \
       imgui/imgui.cpp \
       imgui/imgui_draw.cpp \